@@ -0,0 +1,21 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+
+/*
+ * Shared by the stand-alone benchmarks built with `make bench`.  They
+ * link the player's modules but never its UI, and work on state of their
+ * own rather than the user's library.
+ */
+
+static inline double bench_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 +
+	       (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,152 @@
+/*
+ * durationbench - time MP3 durations from the headers against a scan.
+ *
+ *	bench/durationbench [minutes]
+ *
+ * Writes a CBR, a Xing-tagged VBR and a headerless VBR file of @minutes
+ * (default 10) to a temporary directory, then times mp3_header_duration()
+ * on each against the mpg123_scan() that get_mp3_duration() falls back to.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mpg123.h>
+
+#include "mp3info.h"
+#include "bench.h"
+
+/* Header reads per measurement */
+#define DURATION_BENCH_RUNS	20
+
+/* Silent MPEG-1 Layer III frames at 44.1 kHz stereo, as written below */
+#define MP3_RATE	44100
+#define MP3_SPF		1152
+
+enum { MP3_CBR, MP3_XING, MP3_VBR };
+
+static const char *const kind_names[] = { "CBR", "Xing VBR", "plain VBR" };
+
+/*
+ * Write @frames frames to @path: all at 128 kbit/s, or cycling through
+ * 128-256 kbit/s with or without a Xing frame count in front.  Padding
+ * follows the encoder rule, so every frame lasts exactly 1152 samples.
+ * Return: 0, or -1 if the file could not be written.
+ */
+static int write_mp3(const char *path, int kind, int frames)
+{
+	static const int kbps[] = { 128, 160, 192, 224, 256 };
+	unsigned char frame[1024];
+	int i, k, len, pad, rem = 0, err = 0;
+	FILE *fp = fopen(path, "wb");
+
+	if (!fp)
+		return -1;
+
+	for (i = kind == MP3_XING ? -1 : 0; i < frames && !err; i++) {
+		k = kind == MP3_CBR || i < 0 ? 0 : (i * 7) % 5;
+		rem += 144000 * kbps[k] % MP3_RATE;
+		pad = rem >= MP3_RATE;
+		if (pad)
+			rem -= MP3_RATE;
+		len = 144000 * kbps[k] / MP3_RATE + pad;
+
+		memset(frame, 0, (size_t)len);
+		frame[0] = 0xff;
+		frame[1] = 0xfb;	/* MPEG-1 Layer III, no CRC */
+		frame[2] = (unsigned char)((9 + k) << 4 | pad << 1);
+		if (i < 0) {
+			/* After 32 bytes of stereo side info: tag, flags, frames */
+			memcpy(frame + 36, "Xing", 4);
+			frame[43] = 1;
+			frame[44] = (unsigned char)(frames >> 24);
+			frame[45] = (unsigned char)(frames >> 16);
+			frame[46] = (unsigned char)(frames >> 8);
+			frame[47] = (unsigned char)frames;
+		}
+		err = fwrite(frame, 1, (size_t)len, fp) != (size_t)len;
+	}
+	if (fclose(fp) != 0)
+		err = 1;
+	return err ? -1 : 0;
+}
+
+/* What get_mp3_duration() does when the headers do not tell. */
+static double scan_duration(const char *path)
+{
+	mpg123_handle *mh;
+	double duration = -1.0;
+	long rate;
+	int channels, encoding, err;
+	off_t samples;
+
+	mh = mpg123_new(NULL, &err);
+	if (!mh)
+		return -1.0;
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0);
+	if (mpg123_open(mh, path) == MPG123_OK &&
+	    mpg123_scan(mh) == MPG123_OK &&
+	    mpg123_getformat(mh, &rate, &channels, &encoding) == MPG123_OK &&
+	    (samples = mpg123_length(mh)) > 0)
+		duration = (double)samples / rate;
+	mpg123_close(mh);
+	mpg123_delete(mh);
+	return duration;
+}
+
+int main(int argc, char **argv)
+{
+	const char *tmp = getenv("TMPDIR");
+	char dir[4096], path[4096 + 16];
+	struct timespec start;
+	double header = -1.0, scan, header_ms, scan_ms;
+	int minutes = 10, frames, kind, i, ret = 0;
+
+	if (argc > 2 || (argc == 2 &&
+	    ((minutes = atoi(argv[1])) < 1 || minutes > 600))) {
+		fprintf(stderr, "usage: %s [minutes, 1-600]\n", argv[0]);
+		return 2;
+	}
+	frames = minutes * 60 * MP3_RATE / MP3_SPF;
+
+	if (mpg123_init() != MPG123_OK) {
+		fprintf(stderr, "mpg123_init failed\n");
+		return 1;
+	}
+	snprintf(dir, sizeof(dir), "%s/lmp-durationbench-XXXXXX",
+		 tmp && *tmp ? tmp : "/tmp");
+	if (!mkdtemp(dir)) {
+		perror(dir);
+		return 1;
+	}
+
+	printf("%.1f s per file\n", (double)frames * MP3_SPF / MP3_RATE);
+	for (kind = MP3_CBR; kind <= MP3_VBR; kind++) {
+		snprintf(path, sizeof(path), "%s/%d.mp3", dir, kind);
+		if (write_mp3(path, kind, frames) != 0) {
+			perror(path);
+			unlink(path);
+			ret = 1;
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < DURATION_BENCH_RUNS; i++)
+			header = mp3_header_duration(path);
+		header_ms = bench_ms(&start) / DURATION_BENCH_RUNS;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		scan = scan_duration(path);
+		scan_ms = bench_ms(&start);
+		unlink(path);
+
+		if (header > 0)
+			printf("%-10s headers %8.3f ms (%.1f s), scan %8.1f ms (%.1f s)\n",
+			       kind_names[kind], header_ms, header, scan_ms, scan);
+		else
+			printf("%-10s headers %8.3f ms (must scan), scan %8.1f ms (%.1f s)\n",
+			       kind_names[kind], header_ms, scan_ms, scan);
+	}
+	rmdir(dir);
+	return ret;
+}
@@ -0,0 +1,90 @@
+/*
+ * loadbench - time loading config.json as the library grows.
+ *
+ *	bench/loadbench [max tracks]
+ *
+ * Loads made-up libraries of 10k, 100k and 1M tracks (up to @max) through
+ * config_load_text(), each into a scratch state.  If loading is linear the
+ * time per track stays the same at every size.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "config.h"
+#include "functions.h"
+#include "bench.h"
+
+static const int sizes[] = { 10000, 100000, 1000000 };
+
+#define NSIZES	(sizeof(sizes) / sizeof(sizes[0]))
+
+/*
+ * config.json text for @n made-up tracks, ten to an album directory, and
+ * one playlist holding every other track by ID.
+ */
+static char *make_json(int n)
+{
+	char *buf = malloc((size_t)n * 224 + 256);
+	size_t len = 0;
+	int i;
+
+	if (!buf)
+		return NULL;
+
+	len += sprintf(buf + len, "{\"next_track_id\":%d,\"library\":[", n + 1);
+	for (i = 0; i < n; i++)
+		len += sprintf(buf + len,
+			       "%s{\"id\":%d,\"name\":\"Track %d\",\"path\":"
+			       "\"/music/Artist %d/Album %d/%02d Track %d.mp3\","
+			       "\"duration\":%d,\"size\":%d,\"mtime\":1700000000}",
+			       i ? "," : "", i + 1, i, i / 100, i / 10, i % 10,
+			       i, 120 + i % 300, 4000000 + i);
+	len += sprintf(buf + len,
+		       "],\"playlists\":[{\"name\":\"Every other\",\"track_ids\":[");
+	for (i = 0; i < n; i += 2)
+		len += sprintf(buf + len, "%s%d", i ? "," : "", i + 1);
+	sprintf(buf + len, "]}]}");
+	return buf;
+}
+
+int main(int argc, char **argv)
+{
+	struct timespec start;
+	unsigned long seq;
+	AppState state;
+	double ms;
+	char *json;
+	int max = sizes[NSIZES - 1], failed = 0, ok, n;
+	size_t i;
+
+	if (argc > 2 || (argc == 2 && (max = atoi(argv[1])) < sizes[0])) {
+		fprintf(stderr, "usage: %s [max tracks, at least %d]\n",
+			argv[0], sizes[0]);
+		return 2;
+	}
+
+	for (i = 0; i < NSIZES && sizes[i] <= max; i++) {
+		n = sizes[i];
+		json = make_json(n);
+		if (!json) {
+			fprintf(stderr, "out of memory at %d tracks\n", n);
+			return 1;
+		}
+
+		memset(&state, 0, sizeof(state));
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ok = config_load_text(&state, json, &seq) == 0;
+		ms = bench_ms(&start);
+		ok = ok && state.track_count == n && state.playlist_count == 1 &&
+		     state.playlists[0].track_count == (n + 1) / 2;
+		free_app_state(&state);
+		free(json);
+
+		printf("%8d tracks: %9.1f ms, %6.0f ns/track%s\n", n, ms,
+		       ms * 1e6 / n, ok ? "" : " FAILED");
+		failed |= !ok;
+	}
+	return failed;
+}
@@ -0,0 +1,93 @@
+/*
+ * searchbench - time the trigram index against a scan of every name.
+ *
+ *	bench/searchbench <query> [tracks]
+ *
+ * Searches a made-up library of @tracks names (default 100000) built in a
+ * scratch state, so the index of a running player is never touched.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "functions.h"
+#include "search_index.h"
+#include "bench.h"
+
+/* Searches per measurement */
+#define SEARCH_BENCH_RUNS	20
+
+static const char *const words[] = {
+	"Love", "night", "Dance", "FIRE", "heart", "Rain", "blue", "Moon",
+	"road", "Gold", "Émilie", "sky", "Dream", "Stone", "wild", "Ocean",
+};
+
+#define NWORDS	(sizeof(words) / sizeof(words[0]))
+
+/* One to four words and a number, e.g. "Moon_road_Dream 417". */
+static void make_name(char *buf, size_t size, unsigned *seed)
+{
+	size_t len = 0;
+	int n = 1 + (int)(rand_r(seed) % 4), i;
+
+	for (i = 0; i < n; i++)
+		len += (size_t)snprintf(buf + len, size - len, "%s%s",
+					i ? "_" : "",
+					words[rand_r(seed) % NWORDS]);
+	snprintf(buf + len, size - len, " %u", rand_r(seed) % 1000);
+}
+
+int main(int argc, char **argv)
+{
+	char name[128], path[64];
+	struct timespec start;
+	double build_ms, index_ms, scan_ms;
+	AppState state;
+	unsigned seed = 1;
+	int tracks = 100000, n_index = 0, n_scan = 0, *found, i;
+
+	if (argc < 2 || argc > 3 ||
+	    (argc == 3 && (tracks = atoi(argv[2])) < 1)) {
+		fprintf(stderr, "usage: %s <query> [tracks]\n", argv[0]);
+		return 2;
+	}
+
+	memset(&state, 0, sizeof(state));
+	state.current_track_index = -1;
+	for (i = 0; i < tracks; i++) {
+		make_name(name, sizeof(name), &seed);
+		snprintf(path, sizeof(path), "/music/%d/%d.mp3", i / 100, i);
+		if (library_add_track(&state, name, path, 0) < 0) {
+			fprintf(stderr, "out of memory at %d tracks\n", i);
+			return 1;
+		}
+	}
+
+	/* The first search builds the index. */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	library_search(&state, argv[1], &found);
+	build_ms = bench_ms(&start);
+	free(found);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SEARCH_BENCH_RUNS; i++) {
+		n_index = library_search(&state, argv[1], &found);
+		free(found);
+	}
+	index_ms = bench_ms(&start) / SEARCH_BENCH_RUNS;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < SEARCH_BENCH_RUNS; i++) {
+		n_scan = library_search_scan(&state, argv[1], &found);
+		free(found);
+	}
+	scan_ms = bench_ms(&start) / SEARCH_BENCH_RUNS;
+
+	printf("'%s' over %d tracks: index %.3f ms (%d found, first search "
+	       "%.3f ms), scan %.3f ms (%d found)%s\n",
+	       argv[1], tracks, index_ms, n_index, build_ms, scan_ms, n_scan,
+	       n_index != n_scan ? " MISMATCH" : "");
+	free_app_state(&state);
+	return n_index != n_scan;
+}
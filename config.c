@@ -3,19 +3,28 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "main.h"
 #include "functions.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "library_index.h"
+#include "library_strings.h"
+#include "search_index.h"
 #include "cJSON.h"
 
 #define CONFIG_VERSION		1
 #define CONFIG_PATH_MAX		512
 #define VOLUME_MIN		0
 #define VOLUME_MAX		100
-#define MAX_CONFIG_SIZE		(10 * 1024 * 1024)  /* 10MB max config */
+#define MAX_CONFIG_SIZE		(512 * 1024 * 1024)  /* 512MB max config */
 
-static void ensure_dir_exists(void)
+void config_ensure_dir(void)
 {
 	const char *home = getenv("HOME");
 	char path[CONFIG_PATH_MAX];
@@ -37,7 +46,8 @@ static void ensure_dir_exists(void)
 	}
 }
 
-static void get_config_path(char *buf, size_t size)
+/* Build the path of a file living next to config.json. */
+void config_file_path(char *buf, size_t size, const char *filename)
 {
 	const char *home;
 
@@ -46,30 +56,22 @@ static void get_config_path(char *buf, size_t size)
 
 	home = getenv("HOME");
 	if (!home) {
-		snprintf(buf, size, "config.json");
+		snprintf(buf, size, "%s", filename);
 		return;
 	}
 
-	snprintf(buf, size, "%s/.config/LMP/config.json", home);
+	snprintf(buf, size, "%s/.config/LMP/%s", home, filename);
 }
 
-static int find_track_index_by_name(const AppState *state, const char *name)
+static void get_config_path(char *buf, size_t size)
 {
-	int i;
-
-	if (!state || !name)
-		return -1;
-
-	for (i = 0; i < state->track_count; i++) {
-		if (strcmp(state->library[i].name, name) == 0)
-			return i;
-	}
-	return -1;
+	config_file_path(buf, size, "config.json");
 }
 
 static void save_library(cJSON *root, const AppState *state)
 {
 	cJSON *lib, *t;
+	char *path;
 	int i;
 
 	lib = cJSON_CreateArray();
@@ -81,8 +83,24 @@ static void save_library(cJSON *root, const AppState *state)
 		if (!t)
 			continue;
 
-		cJSON_AddStringToObject(t, "name", state->library[i].name);
-		cJSON_AddStringToObject(t, "path", state->library[i].path);
+		/* IDs are handed out sequentially, far below 2^53. */
+		cJSON_AddNumberToObject(t, "id", (double)state->library[i].id);
+		cJSON_AddStringToObject(t, "name", library_name(state, i));
+		path = library_path_dup(state, i);
+		if (!path) {
+			cJSON_Delete(t);
+			continue;
+		}
+		cJSON_AddStringToObject(t, "path", path);
+		free(path);
+		if (state->library[i].duration != 0.0) {
+			cJSON_AddNumberToObject(t, "duration",
+						state->library[i].duration);
+			cJSON_AddNumberToObject(t, "size",
+						(double)state->library[i].size);
+			cJSON_AddNumberToObject(t, "mtime",
+						(double)state->library[i].mtime);
+		}
 		cJSON_AddItemToArray(lib, t);
 	}
 	cJSON_AddItemToObject(root, "library", lib);
@@ -115,35 +133,61 @@ static void save_playlists(cJSON *root, const AppState *state)
 			idx = pl->track_indices[j];
 			if (idx >= 0 && idx < state->track_count) {
 				cJSON_AddItemToArray(tracks,
-						    cJSON_CreateString(state->library[idx].name));
+						    cJSON_CreateNumber((double)state->library[idx].id));
 			}
 		}
 
-		cJSON_AddItemToObject(plj, "tracks", tracks);
+		cJSON_AddItemToObject(plj, "track_ids", tracks);
 		cJSON_AddItemToArray(pls, plj);
 	}
 	cJSON_AddItemToObject(root, "playlists", pls);
 }
 
-void config_save(const AppState *state)
-{
-	char path[CONFIG_PATH_MAX];
-	cJSON *root = NULL;
-	char *json = NULL;
-	FILE *fp = NULL;
+/* Everything one snapshot publishes; built on the UI thread. */
+struct config_image {
+	char		*json;
+	void		*bin;		/* NULL when library.bin is disabled */
+	size_t		 bin_len;
+	unsigned long	 seq;
+};
 
-	if (!state)
+static void free_image(struct config_image *img)
+{
+	if (!img)
 		return;
+	free(img->json);
+	free(img->bin);
+	free(img);
+}
 
-	get_config_path(path, sizeof(path));
-	ensure_dir_exists();
+static struct config_image *serialize_config(const AppState *state)
+{
+	struct config_image *img;
+	cJSON *root;
 
+	img = calloc(1, sizeof(*img));
 	root = cJSON_CreateObject();
-	if (!root)
-		return;
+	if (!img || !root) {
+		free(img);
+		cJSON_Delete(root);
+		return NULL;
+	}
+
+	img->seq = journal_seq();
 
 	cJSON_AddNumberToObject(root, "version", CONFIG_VERSION);
 	cJSON_AddNumberToObject(root, "volume", state->current_volume);
+	cJSON_AddNumberToObject(root, "save_delay_ms", state->save_delay_ms);
+	cJSON_AddBoolToObject(root, "binary_snapshot", state->binary_snapshot);
+	cJSON_AddNumberToObject(root, "audio_rate", state->audio.rate);
+	cJSON_AddNumberToObject(root, "audio_buffer", state->audio.buffer);
+	cJSON_AddStringToObject(root, "audio_format",
+				audio_format_name(state->audio.format));
+	cJSON_AddBoolToObject(root, "audio_native_rate",
+			      state->audio.native_rate);
+	cJSON_AddNumberToObject(root, "journal_seq", (double)img->seq);
+	cJSON_AddNumberToObject(root, "next_track_id",
+				(double)state->next_track_id);
 
 	if (state->current_track[0] != '\0')
 		cJSON_AddStringToObject(root, "last_track_path",
@@ -152,22 +196,256 @@ void config_save(const AppState *state)
 	save_library(root, state);
 	save_playlists(root, state);
 
-	json = cJSON_Print(root);
-	if (!json)
-		goto cleanup;
+	img->json = cJSON_Print(root);
+	cJSON_Delete(root);
+	if (!img->json) {
+		free(img);
+		return NULL;
+	}
 
-	fp = fopen(path, "wb");
-	if (!fp)
-		goto cleanup;
+	if (state->binary_snapshot)
+		img->bin = snapshot_build(state, img->seq, &img->bin_len);
+	return img;
+}
 
-	if (fprintf(fp, "%s\n", json) < 0)
-		goto cleanup;
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
 
-cleanup:
-	if (fp)
-		fclose(fp);
-	free(json);
-	cJSON_Delete(root);
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/*
+ * Replace path with data so that readers see either the old or the new
+ * file, never a truncated one: write a temp file, fsync it, rename it over
+ * the target and fsync the directory so the rename itself is durable.
+ */
+static int write_file_atomic(const char *path, const char *data, size_t len)
+{
+	char tmp[CONFIG_PATH_MAX + 8];
+	char dir[CONFIG_PATH_MAX];
+	char *slash;
+	int fd, dfd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+
+	if (write_all(fd, data, len) != 0 || fsync(fd) != 0) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	if (close(fd) != 0 || rename(tmp, path) != 0) {
+		unlink(tmp);
+		return -1;
+	}
+
+	snprintf(dir, sizeof(dir), "%s", path);
+	slash = strrchr(dir, '/');
+	if (slash) {
+		*slash = '\0';
+		dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dfd >= 0) {
+			fsync(dfd);
+			close(dfd);
+		}
+	}
+	return 0;
+}
+
+/* Serializes publishers so an older snapshot can never land after a newer one. */
+static pthread_mutex_t g_publish_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * library.bin goes out after config.json and is stamped with its size and
+ * mtime; if we die in between, the stamp no longer matches and the next
+ * start falls back to config.json.
+ */
+static void publish_config(struct config_image *img)
+{
+	char path[CONFIG_PATH_MAX];
+	char bin_path[CONFIG_PATH_MAX];
+	struct stat st;
+	size_t len;
+
+	get_config_path(path, sizeof(path));
+	config_file_path(bin_path, sizeof(bin_path), SNAPSHOT_FILE);
+	config_ensure_dir();
+
+	/* cJSON_Print() leaves no trailing newline; reuse its terminator. */
+	len = strlen(img->json);
+	img->json[len] = '\n';
+
+	pthread_mutex_lock(&g_publish_lock);
+	if (write_file_atomic(path, img->json, len + 1) == 0) {
+		if (img->bin && stat(path, &st) == 0) {
+			snapshot_stamp(img->bin, &st);
+			if (write_file_atomic(bin_path, img->bin, img->bin_len) != 0)
+				unlink(bin_path);
+		} else {
+			unlink(bin_path);
+		}
+		journal_reset(img->seq);
+	}
+	pthread_mutex_unlock(&g_publish_lock);
+}
+
+/* =========================
+ * Write-behind saver
+ *
+ * config_mark_dirty() only records that a snapshot is due.  Once the
+ * coalescing window has passed, config_tick() serializes the state on the
+ * UI thread and hands the text to the saver thread, which does all of the
+ * disk I/O.  A newer hand-off replaces one the saver has not picked up yet.
+ * ========================= */
+
+static pthread_mutex_t g_saver_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_saver_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t g_saver;
+static int g_saver_started;
+static int g_saver_stop;
+static struct config_image *g_saver_img;
+
+static int g_dirty;
+static long long g_dirty_deadline;
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *saver_main(void *arg)
+{
+	struct config_image *img;
+
+	(void)arg;
+
+	pthread_mutex_lock(&g_saver_lock);
+	for (;;) {
+		while (!g_saver_img && !g_saver_stop)
+			pthread_cond_wait(&g_saver_cond, &g_saver_lock);
+		if (!g_saver_img)
+			break;
+
+		img = g_saver_img;
+		g_saver_img = NULL;
+		pthread_mutex_unlock(&g_saver_lock);
+
+		publish_config(img);
+		free_image(img);
+
+		pthread_mutex_lock(&g_saver_lock);
+	}
+	pthread_mutex_unlock(&g_saver_lock);
+	return NULL;
+}
+
+static void saver_submit(struct config_image *img)
+{
+	pthread_mutex_lock(&g_saver_lock);
+	if (!g_saver_started) {
+		if (pthread_create(&g_saver, NULL, saver_main, NULL) != 0) {
+			pthread_mutex_unlock(&g_saver_lock);
+			publish_config(img);
+			free_image(img);
+			return;
+		}
+		g_saver_started = 1;
+	}
+	free_image(g_saver_img);
+	g_saver_img = img;
+	pthread_cond_signal(&g_saver_cond);
+	pthread_mutex_unlock(&g_saver_lock);
+}
+
+void config_mark_dirty(const AppState *state)
+{
+	if (!state || g_dirty)
+		return;
+
+	g_dirty = 1;
+	g_dirty_deadline = now_ms() + (state->save_delay_ms > 0 ?
+				       state->save_delay_ms : 0);
+}
+
+/**
+ * config_tick() - hand a due snapshot to the saver thread.
+ *
+ * Return: milliseconds until the pending snapshot is due, or -1 if
+ * nothing is pending.
+ */
+int config_tick(const AppState *state)
+{
+	struct config_image *img;
+	long long left;
+
+	if (!state || !g_dirty)
+		return -1;
+
+	left = g_dirty_deadline - now_ms();
+	if (left > 0)
+		return (int)left;
+
+	g_dirty = 0;
+	img = serialize_config(state);
+	if (img)
+		saver_submit(img);
+	return -1;
+}
+
+/* Synchronous save; supersedes anything still queued for the saver. */
+void config_save(const AppState *state)
+{
+	struct config_image *img;
+
+	if (!state)
+		return;
+
+	img = serialize_config(state);
+	if (!img)
+		return;
+
+	pthread_mutex_lock(&g_saver_lock);
+	free_image(g_saver_img);
+	g_saver_img = NULL;
+	pthread_mutex_unlock(&g_saver_lock);
+
+	g_dirty = 0;
+	publish_config(img);
+	free_image(img);
+}
+
+/* Let the saver finish any write in flight and stop it. */
+void config_shutdown(void)
+{
+	pthread_mutex_lock(&g_saver_lock);
+	if (!g_saver_started) {
+		pthread_mutex_unlock(&g_saver_lock);
+		return;
+	}
+	g_saver_stop = 1;
+	pthread_cond_signal(&g_saver_cond);
+	pthread_mutex_unlock(&g_saver_lock);
+
+	pthread_join(g_saver, NULL);
+	g_saver_started = 0;
+	g_saver_stop = 0;
 }
 
 static void load_volume(cJSON *root, AppState *state)
@@ -184,6 +462,70 @@ static void load_volume(cJSON *root, AppState *state)
 	}
 }
 
+static void load_save_delay(cJSON *root, AppState *state)
+{
+	cJSON *d = cJSON_GetObjectItem(root, "save_delay_ms");
+
+	if (cJSON_IsNumber(d) && d->valueint >= 0)
+		state->save_delay_ms = d->valueint;
+}
+
+static void load_binary_snapshot_flag(cJSON *root, AppState *state)
+{
+	cJSON *b = cJSON_GetObjectItem(root, "binary_snapshot");
+
+	if (cJSON_IsBool(b))
+		state->binary_snapshot = cJSON_IsTrue(b);
+}
+
+void config_audio_defaults(AudioConfig *audio)
+{
+	audio->rate = CONFIG_DEFAULT_AUDIO_RATE;
+	audio->buffer = CONFIG_DEFAULT_AUDIO_BUFFER;
+	audio->format = AUDIO_FORMAT_S16;
+	audio->native_rate = 0;
+}
+
+/* The device wants a power-of-two buffer. */
+int config_audio_valid(const AudioConfig *audio)
+{
+	return audio->rate >= AUDIO_RATE_MIN && audio->rate <= AUDIO_RATE_MAX &&
+	       audio->buffer >= AUDIO_BUFFER_MIN &&
+	       audio->buffer <= AUDIO_BUFFER_MAX &&
+	       (audio->buffer & (audio->buffer - 1)) == 0 &&
+	       (audio->format == AUDIO_FORMAT_S16 ||
+		audio->format == AUDIO_FORMAT_F32);
+}
+
+/* Bad values keep the defaults, one setting at a time. */
+static void load_audio(cJSON *root, AppState *state)
+{
+	cJSON *rate = cJSON_GetObjectItem(root, "audio_rate");
+	cJSON *buffer = cJSON_GetObjectItem(root, "audio_buffer");
+	cJSON *format = cJSON_GetObjectItem(root, "audio_format");
+	cJSON *native = cJSON_GetObjectItem(root, "audio_native_rate");
+	AudioConfig a = state->audio;
+	int fmt;
+
+	if (cJSON_IsNumber(rate)) {
+		a.rate = rate->valueint;
+		if (!config_audio_valid(&a))
+			a.rate = state->audio.rate;
+	}
+	if (cJSON_IsNumber(buffer)) {
+		a.buffer = buffer->valueint;
+		if (!config_audio_valid(&a))
+			a.buffer = state->audio.buffer;
+	}
+	if (cJSON_IsString(format) &&
+	    (fmt = audio_format_from_name(format->valuestring)) >= 0)
+		a.format = fmt;
+	if (cJSON_IsBool(native))
+		a.native_rate = cJSON_IsTrue(native);
+
+	state->audio = a;
+}
+
 static void load_last_track(cJSON *root, AppState *state)
 {
 	cJSON *lt = cJSON_GetObjectItem(root, "last_track_path");
@@ -195,13 +537,63 @@ static void load_last_track(cJSON *root, AppState *state)
 	}
 }
 
+static uint64_t get_track_id(const cJSON *obj)
+{
+	const cJSON *id = cJSON_GetObjectItem(obj, "id");
+
+	if (!cJSON_IsNumber(id) || id->valuedouble < 1)
+		return 0;
+	return (uint64_t)id->valuedouble;
+}
+
+/*
+ * Reserve every stored ID before assigning any, so that tracks from a
+ * config written before IDs existed cannot take one a later entry owns.
+ */
+static void load_next_track_id(cJSON *root, cJSON *lib, AppState *state)
+{
+	cJSON *next = cJSON_GetObjectItem(root, "next_track_id");
+	cJSON *t;
+	uint64_t id;
+
+	state->next_track_id = 1;
+	if (cJSON_IsNumber(next) && next->valuedouble > 1)
+		state->next_track_id = (uint64_t)next->valuedouble;
+
+	cJSON_ArrayForEach(t, lib) {
+		id = get_track_id(t);
+		if (id >= state->next_track_id)
+			state->next_track_id = id + 1;
+	}
+}
+
+/* Cached duration; dropped unless it comes with the file stamp it was read at. */
+static void load_track_duration(const cJSON *obj, Track *t)
+{
+	const cJSON *dur = cJSON_GetObjectItem(obj, "duration");
+	const cJSON *size = cJSON_GetObjectItem(obj, "size");
+	const cJSON *mtime = cJSON_GetObjectItem(obj, "mtime");
+
+	if (!cJSON_IsNumber(dur) || !cJSON_IsNumber(size) ||
+	    !cJSON_IsNumber(mtime))
+		return;
+
+	t->duration = dur->valuedouble;
+	t->size = (int64_t)size->valuedouble;
+	t->mtime = (int64_t)mtime->valuedouble;
+}
+
 static int load_library(cJSON *root, AppState *state)
 {
 	cJSON *lib, *t, *nm, *pth;
-	int i, n;
+	uint64_t id;
+	int n, idx;
 
 	lib = cJSON_GetObjectItem(root, "library");
 	state->track_count = 0;
+	track_strings_free(&state->strings);
+	search_index_free(state);
+	library_index_rebuild(state);
 
 	if (!cJSON_IsArray(lib))
 		return 0;
@@ -211,11 +603,16 @@ static int load_library(cJSON *root, AppState *state)
 		return 0;
 
 	/* Dynamically expand library to fit all tracks */
-	if (ensure_library_capacity(state, n) != 0)
+	if (ensure_library_capacity(state, n, 0) != 0)
 		return -1;
 
-	for (i = 0; i < n; i++) {
-		t = cJSON_GetArrayItem(lib, i);
+	load_next_track_id(root, lib, state);
+
+	/*
+	 * Walk the child list directly: cJSON_GetArrayItem(lib, i) starts
+	 * from the head every time, which made loading quadratic.
+	 */
+	cJSON_ArrayForEach(t, lib) {
 		if (!cJSON_IsObject(t))
 			continue;
 
@@ -227,19 +624,16 @@ static int load_library(cJSON *root, AppState *state)
 		if (!nm->valuestring || !pth->valuestring)
 			continue;
 
-		strncpy(state->library[state->track_count].name,
-			nm->valuestring,
-			sizeof(state->library[state->track_count].name) - 1);
-		state->library[state->track_count].name[
-			sizeof(state->library[state->track_count].name) - 1] = '\0';
+		/* A missing or duplicate ID gets a fresh one. */
+		id = get_track_id(t);
+		if (id && library_find_by_id(state, id) >= 0)
+			id = 0;
 
-		strncpy(state->library[state->track_count].path,
-			pth->valuestring,
-			sizeof(state->library[state->track_count].path) - 1);
-		state->library[state->track_count].path[
-			sizeof(state->library[state->track_count].path) - 1] = '\0';
-
-		state->track_count++;
+		idx = library_add_track(state, nm->valuestring,
+					pth->valuestring, id);
+		if (idx < 0)
+			return -1;
+		load_track_duration(t, &state->library[idx]);
 	}
 
 	return 0;
@@ -248,7 +642,7 @@ static int load_library(cJSON *root, AppState *state)
 static int load_playlists(cJSON *root, AppState *state)
 {
 	cJSON *pls, *pl, *nm, *tr_arr, *tn;
-	int i, j, n, m, idx;
+	int n, m, idx, by_id;
 	Playlist *current_pl;
 
 	pls = cJSON_GetObjectItem(root, "playlists");
@@ -264,8 +658,7 @@ static int load_playlists(cJSON *root, AppState *state)
 	if (ensure_playlists_capacity(state, n) != 0)
 		return -1;
 
-	for (i = 0; i < n; i++) {
-		pl = cJSON_GetArrayItem(pls, i);
+	cJSON_ArrayForEach(pl, pls) {
 		if (!cJSON_IsObject(pl))
 			continue;
 
@@ -280,19 +673,27 @@ static int load_playlists(cJSON *root, AppState *state)
 		current_pl->name[sizeof(current_pl->name) - 1] = '\0';
 		current_pl->track_count = 0;
 
-		tr_arr = cJSON_GetObjectItem(pl, "tracks");
+		/* Configs written before track IDs list member names instead. */
+		tr_arr = cJSON_GetObjectItem(pl, "track_ids");
+		by_id = cJSON_IsArray(tr_arr);
+		if (!by_id)
+			tr_arr = cJSON_GetObjectItem(pl, "tracks");
+
 		if (cJSON_IsArray(tr_arr)) {
 			m = cJSON_GetArraySize(tr_arr);
 			
 			if (m > 0 && ensure_playlist_tracks_capacity(current_pl, m) != 0)
 				continue;
 
-			for (j = 0; j < m; j++) {
-				tn = cJSON_GetArrayItem(tr_arr, j);
-				if (!cJSON_IsString(tn) || !tn->valuestring)
-					continue;
+			cJSON_ArrayForEach(tn, tr_arr) {
+				if (by_id)
+					idx = cJSON_IsNumber(tn) ?
+					      library_find_by_id(state, (uint64_t)tn->valuedouble) : -1;
+				else if (cJSON_IsString(tn) && tn->valuestring)
+					idx = library_find_by_name(state, tn->valuestring);
+				else
+					idx = -1;
 
-				idx = find_track_index_by_name(state, tn->valuestring);
 				if (idx >= 0) {
 					current_pl->track_indices[current_pl->track_count] = idx;
 					current_pl->track_count++;
@@ -306,23 +707,54 @@ static int load_playlists(cJSON *root, AppState *state)
 	return 0;
 }
 
-void config_load(AppState *state)
+static unsigned long load_journal_seq(cJSON *root)
+{
+	cJSON *seq = cJSON_GetObjectItem(root, "journal_seq");
+
+	if (cJSON_IsNumber(seq) && seq->valuedouble > 0)
+		return (unsigned long)seq->valuedouble;
+	return 0;
+}
+
+/* Load everything config.json holds from its text; 0 on success. */
+int config_load_text(AppState *state, const char *json, unsigned long *seq)
+{
+	cJSON *root;
+	int ret = -1;
+
+	root = cJSON_Parse(json);
+	if (!root)
+		return -1;
+
+	load_volume(root, state);
+	load_save_delay(root, state);
+	load_binary_snapshot_flag(root, state);
+	load_audio(root, state);
+	load_last_track(root, state);
+	*seq = load_journal_seq(root);
+
+	if (load_library(root, state) == 0 && load_playlists(root, state) == 0)
+		ret = 0;
+
+	cJSON_Delete(root);
+	return ret;
+}
+
+/* Parse config.json; returns the journal seq the snapshot is current to. */
+static unsigned long load_json(AppState *state)
 {
 	char path[CONFIG_PATH_MAX];
 	FILE *fp = NULL;
 	char *buf = NULL;
-	cJSON *root = NULL;
+	unsigned long seq = 0;
 	long sz;
 	size_t read_size;
 
-	if (!state)
-		return;
-
 	get_config_path(path, sizeof(path));
 
 	fp = fopen(path, "rb");
 	if (!fp)
-		return;
+		return 0;
 
 	if (fseek(fp, 0, SEEK_END) != 0)
 		goto cleanup;
@@ -344,22 +776,52 @@ void config_load(AppState *state)
 
 	buf[sz] = '\0';
 
-	root = cJSON_Parse(buf);
-	if (!root)
-		goto cleanup;
-
-	load_volume(root, state);
-	load_last_track(root, state);
-	
-	if (load_library(root, state) != 0)
-		goto cleanup;
-	
-	if (load_playlists(root, state) != 0)
-		goto cleanup;
+	config_load_text(state, buf, &seq);
 
 cleanup:
-	cJSON_Delete(root);
 	free(buf);
 	if (fp)
 		fclose(fp);
-}
\ No newline at end of file
+	return seq;
+}
+
+/* Write library.bin for a config.json that was loaded the slow way. */
+static void regenerate_binary(const AppState *state, unsigned long seq,
+			      const struct stat *json_st)
+{
+	char bin_path[CONFIG_PATH_MAX];
+	size_t len;
+	void *bin;
+
+	bin = snapshot_build(state, seq, &len);
+	if (!bin)
+		return;
+
+	snapshot_stamp(bin, json_st);
+	config_file_path(bin_path, sizeof(bin_path), SNAPSHOT_FILE);
+	pthread_mutex_lock(&g_publish_lock);
+	write_file_atomic(bin_path, bin, len);
+	pthread_mutex_unlock(&g_publish_lock);
+	free(bin);
+}
+
+void config_load(AppState *state)
+{
+	char path[CONFIG_PATH_MAX];
+	struct stat st;
+	unsigned long seq = 0;
+
+	if (!state)
+		return;
+
+	get_config_path(path, sizeof(path));
+	if (stat(path, &st) == 0) {
+		if (snapshot_load(state, &st, &seq) != 0) {
+			seq = load_json(state);
+			if (state->binary_snapshot)
+				regenerate_binary(state, seq, &st);
+		}
+	}
+
+	journal_replay(state, seq);
+}
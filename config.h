@@ -1,9 +1,31 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 #include "main.h"
 
+/* Default coalescing window for background snapshot writes */
+#define CONFIG_DEFAULT_SAVE_DELAY_MS	2000
+
+/* Audio device defaults and the range accepted from config.json */
+#define CONFIG_DEFAULT_AUDIO_RATE	44100
+#define CONFIG_DEFAULT_AUDIO_BUFFER	2048
+#define AUDIO_RATE_MIN			8000
+#define AUDIO_RATE_MAX			192000
+#define AUDIO_BUFFER_MIN		64
+#define AUDIO_BUFFER_MAX		16384
+
+void config_audio_defaults(AudioConfig *audio);
+int config_audio_valid(const AudioConfig *audio);
+
 void config_load(AppState *state);
+int config_load_text(AppState *state, const char *json, unsigned long *seq);
 void config_save(const AppState *state);
+void config_mark_dirty(const AppState *state);
+int config_tick(const AppState *state);
+void config_shutdown(void);
+void config_ensure_dir(void);
+void config_file_path(char *buf, size_t size, const char *filename);
 
 #endif /* CONFIG_H */
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "events.h"
+
+/*
+ * Elsewhere the eventfd is a non-blocking pipe and the tick is folded
+ * into the poll() timeout.
+ */
+static int g_notify_rd = -1;
+static int g_notify_wr = -1;
+static int g_timer = -1;
+static int g_tick_ms;		/* what the timer is armed with, 0 if not */
+
+static int set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -1;
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return 0;
+}
+
+int events_init(void)
+{
+#ifdef __linux__
+	g_notify_rd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (g_notify_rd >= 0)
+		g_notify_wr = g_notify_rd;
+	g_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+#endif
+	if (g_notify_rd < 0) {
+		int fds[2];
+
+		if (pipe(fds) != 0)
+			return -1;
+		if (set_nonblock(fds[0]) != 0 || set_nonblock(fds[1]) != 0) {
+			close(fds[0]);
+			close(fds[1]);
+			return -1;
+		}
+		g_notify_rd = fds[0];
+		g_notify_wr = fds[1];
+	}
+	return 0;
+}
+
+void events_shutdown(void)
+{
+	if (g_notify_wr >= 0 && g_notify_wr != g_notify_rd)
+		close(g_notify_wr);
+	if (g_notify_rd >= 0)
+		close(g_notify_rd);
+	if (g_timer >= 0)
+		close(g_timer);
+	g_notify_rd = g_notify_wr = g_timer = -1;
+	g_tick_ms = 0;
+}
+
+/* Wake the main loop.  Safe from any thread, the audio callback included. */
+void events_notify(void)
+{
+	uint64_t one = 1;
+	ssize_t n;
+
+	if (g_notify_wr < 0)
+		return;
+	/* A full pipe or a saturated counter already means "wake up". */
+	n = write(g_notify_wr, &one,
+		  g_notify_wr == g_notify_rd ? sizeof(one) : 1);
+	(void)n;
+}
+
+static void drain(int fd)
+{
+	char buf[64];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+static void arm_timer(int tick_ms)
+{
+#ifdef __linux__
+	struct itimerspec its;
+
+	if (g_timer < 0 || tick_ms == g_tick_ms)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	its.it_interval.tv_sec = tick_ms / 1000;
+	its.it_interval.tv_nsec = (long)(tick_ms % 1000) * 1000000L;
+	its.it_value = its.it_interval;
+	timerfd_settime(g_timer, 0, &its, NULL);
+#endif
+	g_tick_ms = tick_ms;
+}
+
+/**
+ * events_wait() - sleep until something needs the main loop.
+ * @tick_ms:    period of the tick timer, 0 to disarm it.  Re-arming with
+ *              the same period keeps the phase.
+ * @timeout_ms: one-off deadline on top of that, -1 for none.
+ *
+ * Return: a mask of EV_* bits; 0 if interrupted by a signal (SIGWINCH).
+ */
+int events_wait(int tick_ms, int timeout_ms)
+{
+	struct pollfd pfd[3];
+	int n = 0, ret = 0, timer_idx = -1;
+
+	if (tick_ms < 0)
+		tick_ms = 0;
+	arm_timer(tick_ms);
+
+	pfd[n].fd = STDIN_FILENO;
+	pfd[n++].events = POLLIN;
+	pfd[n].fd = g_notify_rd;
+	pfd[n++].events = POLLIN;
+	if (g_timer >= 0 && tick_ms > 0) {
+		timer_idx = n;
+		pfd[n].fd = g_timer;
+		pfd[n++].events = POLLIN;
+	} else if (tick_ms > 0 && (timeout_ms < 0 || tick_ms < timeout_ms)) {
+		timeout_ms = tick_ms;
+	}
+
+	switch (poll(pfd, (nfds_t)n, timeout_ms)) {
+	case -1:
+		return 0;
+	case 0:
+		return g_timer < 0 && tick_ms > 0 ? EV_TICK | EV_TIMEOUT
+						  : EV_TIMEOUT;
+	}
+
+	if (pfd[0].revents)
+		ret |= EV_INPUT;
+	if (pfd[1].revents) {
+		drain(g_notify_rd);
+		ret |= EV_PLAYBACK;
+	}
+	if (timer_idx >= 0 && pfd[timer_idx].revents) {
+		drain(g_timer);
+		ret |= EV_TICK;
+	}
+	return ret;
+}
@@ -0,0 +1,23 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+/*
+ * What the main loop sleeps on.
+ *
+ * A single poll() covers stdin, an eventfd that the audio callbacks poke
+ * when a track ends or switches, and a timerfd for progress ticks.  With
+ * nothing playing and no background work the timer is disarmed and the
+ * process sleeps until a key is pressed.
+ */
+
+#define EV_INPUT	0x1	/* stdin is readable */
+#define EV_PLAYBACK	0x2	/* events_notify() was called */
+#define EV_TICK		0x4	/* the tick timer expired */
+#define EV_TIMEOUT	0x8	/* timeout_ms elapsed */
+
+int events_init(void);
+void events_shutdown(void);
+void events_notify(void);
+int events_wait(int tick_ms, int timeout_ms);
+
+#endif /* EVENTS_H */
@@ -0,0 +1,20 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <stddef.h>
+
+/*
+ * Search keys: names folded once, when they are stored, so that searching
+ * compares plain bytes.
+ *
+ * Letters are lower cased and lose their accents, whether those come
+ * precomposed or as combining marks, so "Beyoncé", "BEYONCE" and a
+ * decomposed "Beyonce\xcc\x81" all give "beyonce"; ß gives "ss".  That is
+ * done for Latin (Latin Extended Additional too), Greek and Cyrillic.
+ * Other characters, and bytes that are not UTF-8, are kept as they are.
+ * A key is never longer than the string it was made from.
+ */
+
+size_t fold_key(const char *s, char *out);
+
+#endif /* FOLD_H */
@@ -6,13 +6,27 @@
 
 #include "main.h"
 #include "config.h"
+#include "journal.h"
+#include "library_index.h"
+#include "library_strings.h"
+#include "search_index.h"
+#include "scanner.h"
+#include "probe.h"
+#include "mp3info.h"
+#include "events.h"
+#include "jobs.h"
 #include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <strings.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 /* Initial capacities for dynamic arrays (backward-compatible defaults) */
 #define LMP_INIT_LIBRARY_CAP	100
@@ -23,7 +37,12 @@
  * Dynamic array helpers
  * ========================= */
 
-int ensure_library_capacity(struct AppState *state, int additional)
+/*
+ * Room for @additional more tracks and @string_bytes more of their names
+ * and paths (0 if not known; the string arena grows as needed anyway).
+ */
+int ensure_library_capacity(struct AppState *state, int additional,
+			    size_t string_bytes)
 {
 	size_t need, newcap;
 	Track *tmp;
@@ -32,6 +51,9 @@ int ensure_library_capacity(struct AppState *state, int additional)
 		return -1;
 	if (additional < 0)
 		additional = 0;
+	if (string_bytes &&
+	    track_strings_reserve(&state->strings, string_bytes) != 0)
+		return -1;
 
 	if ((size_t)state->library_cap >=
 	    (size_t)state->track_count + (size_t)additional)
@@ -142,20 +164,631 @@ void free_app_state(struct AppState *state)
 	state->playlists_cap = 0;
 	state->playlist_count = 0;
 
+	library_index_free(state);
+	search_index_free(state);
+	track_strings_free(&state->strings);
 	free(state->library);
 	state->library = NULL;
 	state->library_cap = 0;
 	state->track_count = 0;
 }
 
+/* =========================
+ * Library / playlist mutations
+ *
+ * Commands and journal replay both go through these so that replaying
+ * the journal reproduces exactly what the commands did.
+ * ========================= */
+
+/* Next slot the duration probe sweep will queue; see library_probe_poll(). */
+static int g_probe_cursor;
+
+/* id 0 assigns the next free ID; loaders and replay pass the stored one. */
+int library_add_track(struct AppState *state, const char *name,
+		      const char *path, uint64_t id)
+{
+	Track *t;
+
+	if (!state || !name || !path)
+		return -1;
+	if (ensure_library_capacity(state, 1,
+				    strlen(name) + strlen(path) + 2) != 0)
+		return -1;
+
+	if (state->next_track_id == 0)
+		state->next_track_id = 1;
+	if (id == 0)
+		id = state->next_track_id;
+	if (id >= state->next_track_id)
+		state->next_track_id = id + 1;
+
+	t = &state->library[state->track_count];
+	memset(t, 0, sizeof(*t));
+	if (track_strings_add(&state->strings, t, name, path) != 0)
+		return -1;
+	t->id = id;
+
+	state->track_count++;
+	library_index_insert(state, state->track_count - 1);
+	search_index_add(state, state->track_count - 1);
+
+	/* The playing file was just added to the library. */
+	if (state->current_track_index < 0 &&
+	    strcmp(path, state->current_track) == 0)
+		state->current_track_index = state->track_count - 1;
+	return state->track_count - 1;
+}
+
+void library_remove_track(struct AppState *state, int idx)
+{
+	int p, r, w;
+
+	if (!state || idx < 0 || idx >= state->track_count)
+		return;
+
+	/* Drop references to idx and shift the ones above it down. */
+	for (p = 0; p < state->playlist_count; p++) {
+		Playlist *pl = &state->playlists[p];
+
+		if (!pl->track_indices || pl->track_count <= 0) {
+			pl->track_count = 0;
+			continue;
+		}
+
+		w = 0;
+		for (r = 0; r < pl->track_count; r++) {
+			int t = pl->track_indices[r];
+
+			if (t == idx)
+				continue;
+			if (t > idx)
+				t--;
+			pl->track_indices[w++] = t;
+		}
+		pl->track_count = w;
+	}
+
+	search_index_remove(state, idx);
+	track_strings_drop(&state->strings, &state->library[idx]);
+	memmove(&state->library[idx], &state->library[idx + 1],
+		(size_t)(state->track_count - idx - 1) *
+		sizeof(*state->library));
+	state->track_count--;
+	if (idx < g_probe_cursor)
+		g_probe_cursor--;
+	if (idx == state->current_track_index)
+		state->current_track_index = -1;
+	else if (idx < state->current_track_index)
+		state->current_track_index--;
+
+	/* Every slot above idx moved; renumbering costs the same as this. */
+	library_strings_compact(state);
+	library_index_rebuild(state);
+}
+
+/**
+ * library_set_current() - make @path the current track.
+ *
+ * Looks it up in the library once, so that showing its name does not
+ * need a lookup per redraw; library_add_track() and library_remove_track()
+ * keep the slot up to date afterwards.
+ */
+void library_set_current(struct AppState *state, const char *path)
+{
+	if (path != state->current_track) {
+		strncpy(state->current_track, path,
+			sizeof(state->current_track) - 1);
+		state->current_track[sizeof(state->current_track) - 1] = '\0';
+	}
+	state->current_track_index = state->current_track[0] ?
+		library_find_by_path(state, state->current_track) : -1;
+}
+
+/* Library name of the current track, else its file name. */
+const char *library_current_name(const struct AppState *state)
+{
+	const char *slash;
+
+	if (state->current_track_index >= 0 &&
+	    state->current_track_index < state->track_count)
+		return library_name(state, state->current_track_index);
+
+	slash = strrchr(state->current_track, '/');
+	return slash ? slash + 1 : state->current_track;
+}
+
+int library_rename_track(struct AppState *state, int idx, const char *name)
+{
+	Track *t;
+
+	if (!state || !name || idx < 0 || idx >= state->track_count)
+		return -1;
+
+	t = &state->library[idx];
+	library_index_erase_name(state, idx);
+	search_index_remove(state, idx);
+	if (track_strings_rename(&state->strings, t, name) != 0) {
+		library_index_insert_name(state, idx);
+		search_index_add(state, idx);
+		return -1;
+	}
+	/* Slots and keys stay the same, so the indexes survive this. */
+	library_strings_compact(state);
+	library_index_insert_name(state, idx);
+	search_index_add(state, idx);
+	return 0;
+}
+
+int playlist_create(struct AppState *state, const char *name)
+{
+	Playlist *pl;
+
+	if (!state || !name)
+		return -1;
+	if (ensure_playlists_capacity(state, 1) != 0)
+		return -1;
+
+	pl = &state->playlists[state->playlist_count];
+	pl->track_count = 0;
+	if (ensure_playlist_tracks_capacity(pl, 1) != 0)
+		return -1;
+
+	strncpy(pl->name, name, sizeof(pl->name) - 1);
+	pl->name[sizeof(pl->name) - 1] = '\0';
+
+	return state->playlist_count++;
+}
+
+void playlist_delete(struct AppState *state, int pidx)
+{
+	if (!state || pidx < 0 || pidx >= state->playlist_count)
+		return;
+
+	free(state->playlists[pidx].track_indices);
+
+	memmove(&state->playlists[pidx], &state->playlists[pidx + 1],
+		(size_t)(state->playlist_count - pidx - 1) *
+		sizeof(*state->playlists));
+	state->playlist_count--;
+
+	/* The vacated tail slot still aliases the last playlist's array. */
+	memset(&state->playlists[state->playlist_count], 0,
+	       sizeof(*state->playlists));
+
+	if (state->playing_playlist_index == pidx)
+		state->playing_playlist_index = -1;
+	else if (state->playing_playlist_index > pidx)
+		state->playing_playlist_index--;
+}
+
+int playlist_append_track(struct AppState *state, int pidx, int track_idx)
+{
+	Playlist *pl;
+
+	if (!state || pidx < 0 || pidx >= state->playlist_count)
+		return -1;
+	if (track_idx < 0 || track_idx >= state->track_count)
+		return -1;
+
+	pl = &state->playlists[pidx];
+	if (ensure_playlist_tracks_capacity(pl, 1) != 0)
+		return -1;
+
+	pl->track_indices[pl->track_count++] = track_idx;
+	return 0;
+}
+
+void playlist_remove_at(struct AppState *state, int pidx, int pos)
+{
+	Playlist *pl;
+
+	if (!state || pidx < 0 || pidx >= state->playlist_count)
+		return;
+
+	pl = &state->playlists[pidx];
+	if (pos < 0 || pos >= pl->track_count)
+		return;
+
+	memmove(&pl->track_indices[pos], &pl->track_indices[pos + 1],
+		(size_t)(pl->track_count - pos - 1) *
+		sizeof(*pl->track_indices));
+	pl->track_count--;
+}
+
 /* =========================
  * Audio backend (SDL_mixer + mpg123)
+ *
+ * MP3s are decoded by our own decoder thread with mpg123, in the device's
+ * format, into a single-producer/single-consumer PCM ring that the
+ * Mix_HookMusic() callback drains without taking any lock.  The decoder
+ * carries on with the queued next track the moment the current one ends,
+ * so consecutive tracks play without a gap.  Anything that is not an MP3
+ * goes through Mix_LoadMUS() as before.
  * ========================= */
 
-/* Global variables to hold the music track and timing */
+/* About this much decoded audio is kept ahead of the device. */
+#define RING_MS			1000
+#define DECODE_CHUNK		16384
+#define MARKER_SLOTS		16	/* power of two */
+#define DECODER_WAIT_MS		20
+
+struct stream {
+	mpg123_handle	*mh;
+	char		*path;
+	int		 eof;
+};
+
+enum marker_kind {
+	MARK_TRACK,	/* the queued track starts here */
+	MARK_END,	/* nothing follows; playback stops here */
+};
+
+struct marker {
+	uint64_t	pos;
+	unsigned	epoch;	/* g_flush_seq when it was written */
+	int		kind;
+};
+
+/*
+ * read and write are running byte counts that never wrap; the buffer
+ * index is pos & (size - 1).  Only the decoder advances write and mark_w,
+ * only the audio callback advances read and mark_r.
+ */
+struct pcm_ring {
+	unsigned char		*buf;
+	size_t			 size;		/* power of two */
+	_Atomic uint64_t	 write;
+	_Atomic uint64_t	 read;
+	struct marker		 marks[MARKER_SLOTS];
+	atomic_uint		 mark_w;
+	atomic_uint		 mark_r;
+};
+
+static pthread_once_t g_mpg123_once = PTHREAD_ONCE_INIT;
+static int g_mpg123_err;
+
+static void mpg123_init_once(void)
+{
+	g_mpg123_err = mpg123_init();
+}
+
+static int has_mp3_ext(const char *name);
+
+/* Mix_Music fallback */
 static Mix_Music *g_music;
-static Uint32 g_start_ticks;
-static Uint32 g_paused_ticks;
+static atomic_int g_music_running;	/* playing and not paused */
+
+/* Device format, from Mix_QuerySpec() */
+static int g_dev_rate;
+static int g_dev_channels;
+static int g_dev_frame_bytes;
+static int g_dev_encoding;	/* mpg123 encoding matching it, 0 if none */
+
+/* Decoder thread; the streams belong to whoever holds g_dec_lock. */
+static pthread_mutex_t g_dec_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_dec_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t g_decoder;
+static int g_decoder_started;
+static int g_dec_stop;
+static struct stream g_cur;
+static struct stream g_next;
+
+static struct pcm_ring g_ring;
+
+/*
+ * Dropping what is in the ring (new track, stop) is done by the consumer:
+ * the UI publishes where the ring ends now and bumps g_flush_seq, and the
+ * callback moves its read side there when it sees the new seq.
+ */
+static _Atomic uint64_t g_flush_to;
+static atomic_uint g_flush_mark;
+static atomic_uint_fast64_t g_flush_frames;	/* position the new data starts at */
+static atomic_uint g_flush_seq;
+static unsigned g_flush_seen;		/* the callback's: last seq it applied */
+
+static atomic_int g_streaming;		/* an MP3 is loaded and has not ended */
+static atomic_int g_stream_paused;
+static atomic_int g_stream_volume = MIX_MAX_VOLUME;
+static atomic_uint g_switches;		/* MARK_TRACKs played, for the UI */
+static atomic_ulong g_underruns;
+
+/*
+ * Frames of the current track handed to the device so far, counted in the
+ * audio callbacks.  draw_ui() reads it without taking any lock.
+ */
+static atomic_uint_fast64_t g_frames;
+
+static void count_frames(size_t bytes)
+{
+	atomic_fetch_add_explicit(&g_frames, bytes / (size_t)g_dev_frame_bytes,
+				  memory_order_relaxed);
+}
+
+static void stream_close(struct stream *s)
+{
+	if (s->mh) {
+		mpg123_close(s->mh);
+		mpg123_delete(s->mh);
+	}
+	free(s->path);
+	memset(s, 0, sizeof(*s));
+}
+
+/* Decode up to len bytes into out; sets s->eof at the end or on error. */
+static size_t stream_read(struct stream *s, unsigned char *out, size_t len)
+{
+	size_t got = 0, done;
+	int err;
+
+	while (got < len && !s->eof) {
+		err = mpg123_read(s->mh, out + got, len - got, &done);
+		got += done;
+		if (err == MPG123_NEW_FORMAT)
+			continue;
+		if (err != MPG123_OK)
+			s->eof = 1;
+		else if (done == 0)
+			s->eof = 1;
+	}
+	return got;
+}
+
+static int stream_open(struct stream *s, const char *path)
+{
+	int err;
+
+	memset(s, 0, sizeof(*s));
+
+	s->mh = mpg123_new(NULL, &err);
+	if (!s->mh)
+		return -1;
+
+	/* Output exactly what the device takes; mpg123 resamples if needed. */
+	mpg123_param(s->mh, MPG123_ADD_FLAGS, MPG123_QUIET | MPG123_GAPLESS, 0);
+	mpg123_format_none(s->mh);
+	if (mpg123_format(s->mh, g_dev_rate,
+			  g_dev_channels == 1 ? MPG123_MONO : MPG123_STEREO,
+			  g_dev_encoding) != MPG123_OK ||
+	    mpg123_open(s->mh, path) != MPG123_OK ||
+	    !(s->path = strdup(path))) {
+		mpg123_delete(s->mh);
+		s->mh = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* Decoder side, g_dec_lock held. */
+static int ring_push_marker(int kind)
+{
+	unsigned w = atomic_load_explicit(&g_ring.mark_w, memory_order_relaxed);
+	struct marker *m;
+
+	if (w - atomic_load_explicit(&g_ring.mark_r, memory_order_acquire) >=
+	    MARKER_SLOTS)
+		return -1;
+
+	m = &g_ring.marks[w & (MARKER_SLOTS - 1)];
+	m->pos = atomic_load_explicit(&g_ring.write, memory_order_relaxed);
+	m->epoch = atomic_load_explicit(&g_flush_seq, memory_order_relaxed);
+	m->kind = kind;
+	atomic_store_explicit(&g_ring.mark_w, w + 1, memory_order_release);
+	return 0;
+}
+
+/*
+ * Forget everything decoded so far; what comes next is heard as frame
+ * @frames of its track.  g_dec_lock held.
+ */
+static void ring_flush(uint64_t frames)
+{
+	atomic_store(&g_flush_to, atomic_load(&g_ring.write));
+	atomic_store(&g_flush_mark, atomic_load(&g_ring.mark_w));
+	atomic_store(&g_flush_frames, frames);
+	atomic_fetch_add_explicit(&g_flush_seq, 1, memory_order_release);
+}
+
+static void timed_wait(pthread_cond_t *cond, pthread_mutex_t *lock, int ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += (long)ms * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	pthread_cond_timedwait(cond, lock, &ts);
+}
+
+/*
+ * Keep the ring full.  Decoding happens with g_dec_lock held, one chunk
+ * at a time, so the UI can swap streams between chunks; the audio
+ * callback is never blocked by it.  When the ring (or the marker queue)
+ * is full the decoder polls every DECODER_WAIT_MS, since the callback
+ * must not signal it.
+ */
+static void *decoder_main(void *arg)
+{
+	uint64_t w, r;
+	size_t space, off, n;
+	unsigned mw, mr;
+
+	(void)arg;
+
+	pthread_mutex_lock(&g_dec_lock);
+	while (!g_dec_stop) {
+		if (!g_cur.mh) {
+			pthread_cond_wait(&g_dec_cond, &g_dec_lock);
+			continue;
+		}
+
+		w = atomic_load_explicit(&g_ring.write, memory_order_relaxed);
+		r = atomic_load_explicit(&g_ring.read, memory_order_acquire);
+		mw = atomic_load_explicit(&g_ring.mark_w, memory_order_relaxed);
+		mr = atomic_load_explicit(&g_ring.mark_r, memory_order_acquire);
+		space = g_ring.size - (size_t)(w - r);
+		if (space < DECODE_CHUNK || mw - mr >= MARKER_SLOTS) {
+			timed_wait(&g_dec_cond, &g_dec_lock, DECODER_WAIT_MS);
+			continue;
+		}
+
+		off = (size_t)(w & (g_ring.size - 1));
+		n = g_ring.size - off;
+		if (n > DECODE_CHUNK)
+			n = DECODE_CHUNK;
+		n = stream_read(&g_cur, g_ring.buf + off, n);
+		atomic_store_explicit(&g_ring.write, w + n,
+				      memory_order_release);
+
+		if (!g_cur.eof)
+			continue;
+
+		stream_close(&g_cur);
+		if (g_next.mh) {
+			g_cur = g_next;
+			memset(&g_next, 0, sizeof(g_next));
+			ring_push_marker(MARK_TRACK);
+		} else {
+			ring_push_marker(MARK_END);
+		}
+	}
+	pthread_mutex_unlock(&g_dec_lock);
+	return NULL;
+}
+
+static void scale_volume(unsigned char *buf, size_t len, int volume)
+{
+	size_t i;
+
+	if (volume >= MIX_MAX_VOLUME)
+		return;
+
+	if (g_dev_encoding == MPG123_ENC_FLOAT_32) {
+		float *f = (float *)buf;
+
+		for (i = 0; i < len / sizeof(float); i++)
+			f[i] = f[i] * volume / MIX_MAX_VOLUME;
+	} else {
+		Sint16 *s = (Sint16 *)buf;
+
+		for (i = 0; i < len / sizeof(Sint16); i++)
+			s[i] = (Sint16)(s[i] * volume / MIX_MAX_VOLUME);
+	}
+}
+
+/* Mix_HookMusic() callback, on SDL's audio thread.  Lock-free. */
+static void stream_mix(void *udata, Uint8 *out, int len)
+{
+	const struct marker *m;
+	size_t got = 0, want = (size_t)len, avail, off, n;
+	uint64_t r, w;
+	unsigned seq, mr, mw;
+
+	(void)udata;
+
+	/* Retry if another flush lands while we pick this one up. */
+	while ((seq = atomic_load_explicit(&g_flush_seq,
+					   memory_order_acquire)) != g_flush_seen) {
+		atomic_store_explicit(&g_ring.read, atomic_load(&g_flush_to),
+				      memory_order_release);
+		atomic_store_explicit(&g_ring.mark_r,
+				      atomic_load(&g_flush_mark),
+				      memory_order_release);
+		atomic_store_explicit(&g_frames, atomic_load(&g_flush_frames),
+				      memory_order_relaxed);
+		g_flush_seen = seq;
+	}
+
+	while (atomic_load_explicit(&g_streaming, memory_order_relaxed) &&
+	       !atomic_load_explicit(&g_stream_paused, memory_order_relaxed) &&
+	       got < want) {
+		r = atomic_load_explicit(&g_ring.read, memory_order_relaxed);
+		w = atomic_load_explicit(&g_ring.write, memory_order_acquire);
+		avail = (size_t)(w - r);
+
+		/* Stop short of the next marker and act on it once reached. */
+		mr = atomic_load_explicit(&g_ring.mark_r, memory_order_relaxed);
+		mw = atomic_load_explicit(&g_ring.mark_w, memory_order_acquire);
+		if (mr != mw) {
+			m = &g_ring.marks[mr & (MARKER_SLOTS - 1)];
+			if (m->epoch != g_flush_seen || m->pos <= r) {
+				atomic_store_explicit(&g_ring.mark_r, mr + 1,
+						      memory_order_release);
+				if (m->epoch != g_flush_seen)
+					continue;
+				if (m->kind == MARK_END) {
+					atomic_store(&g_streaming, 0);
+					events_notify();
+					break;
+				}
+				atomic_fetch_add(&g_switches, 1);
+				atomic_store_explicit(&g_frames, 0,
+						      memory_order_relaxed);
+				events_notify();
+				continue;
+			}
+			if (m->pos - r < avail)
+				avail = (size_t)(m->pos - r);
+		}
+
+		if (avail == 0) {
+			atomic_fetch_add_explicit(&g_underruns, 1,
+						  memory_order_relaxed);
+			break;
+		}
+
+		n = want - got < avail ? want - got : avail;
+		off = (size_t)(r & (g_ring.size - 1));
+		if (n > g_ring.size - off)
+			n = g_ring.size - off;
+		memcpy(out + got, g_ring.buf + off, n);
+		atomic_store_explicit(&g_ring.read, r + n, memory_order_release);
+		count_frames(n);
+		got += n;
+	}
+
+	scale_volume(out, got,
+		     atomic_load_explicit(&g_stream_volume,
+					  memory_order_relaxed));
+	memset(out + got, 0, want - got);
+}
+
+/* Drop both streams and whatever was decoded from them. */
+static void stream_stop(void)
+{
+	struct stream cur, next;
+
+	pthread_mutex_lock(&g_dec_lock);
+	cur = g_cur;
+	next = g_next;
+	memset(&g_cur, 0, sizeof(g_cur));
+	memset(&g_next, 0, sizeof(g_next));
+	atomic_store(&g_streaming, 0);
+	atomic_store(&g_stream_paused, 0);
+	ring_flush(0);
+	pthread_mutex_unlock(&g_dec_lock);
+
+	stream_close(&cur);
+	stream_close(&next);
+}
+
+/* Mix_SetPostMix() callback: counts frames while Mix_Music is playing. */
+static void music_postmix(void *udata, Uint8 *out, int len)
+{
+	(void)udata;
+	(void)out;
+
+	if (atomic_load_explicit(&g_music_running, memory_order_relaxed))
+		count_frames((size_t)len);
+}
+
+/* Mix_HookMusicFinished() callback */
+static void music_finished(void)
+{
+	atomic_store(&g_music_running, 0);
+	events_notify();
+}
 
 void player_set_volume(int involume)
 {
@@ -169,9 +802,292 @@ void player_set_volume(int involume)
 		volume = MIX_MAX_VOLUME;
 
 	Mix_VolumeMusic(volume);
+	atomic_store(&g_stream_volume, volume);
+}
+
+/*
+ * Frame indexes of recently played tracks.  Building one means parsing
+ * every frame header of the file once (mpg123_scan()), which the probe
+ * thread does (seek_index_build()); after that a seek anywhere in the
+ * track only reads from the nearest indexed frame, and until then mpg123
+ * finds the frame by itself.  The index is tied to the file's size and
+ * mtime, so a rewritten file is scanned again.  All under g_seek_lock.
+ */
+#define SEEK_INDEX_SLOTS	8
+
+struct seek_index {
+	char		*path;
+	int64_t		 size;
+	int64_t		 mtime;
+	off_t		*offsets;
+	off_t		 step;
+	size_t		 fill;
+	unsigned long	 used;		/* LRU stamp */
+};
+
+static pthread_mutex_t g_seek_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct seek_index g_seek_index[SEEK_INDEX_SLOTS];
+static unsigned long g_seek_clock;
+
+static void seek_index_clear(struct seek_index *ix)
+{
+	free(ix->path);
+	free(ix->offsets);
+	memset(ix, 0, sizeof(*ix));
+}
+
+/*
+ * The current index of path, or NULL and in *victim the slot a new one
+ * should take.  g_seek_lock held.
+ */
+static struct seek_index *seek_index_find(const char *path,
+					  const struct stat *st,
+					  struct seek_index **victim)
+{
+	struct seek_index *ix, *lru = &g_seek_index[0];
+	int i;
+
+	for (i = 0; i < SEEK_INDEX_SLOTS; i++) {
+		ix = &g_seek_index[i];
+		if (ix->path && strcmp(ix->path, path) == 0) {
+			if (ix->size == (int64_t)st->st_size &&
+			    ix->mtime == (int64_t)st->st_mtime) {
+				ix->used = ++g_seek_clock;
+				return ix;
+			}
+			lru = ix;
+			break;
+		}
+		if (ix->used < lru->used)
+			lru = ix;
+	}
+	if (victim)
+		*victim = lru;
+	return NULL;
 }
 
-int player_init(void)
+/**
+ * seek_index_build() - index the frames of @path unless that is done.
+ *
+ * Called on the probe thread.  The scan runs on a handle of its own with
+ * no lock held; only storing the result takes g_seek_lock.
+ */
+void seek_index_build(const char *path)
+{
+	struct seek_index *victim;
+	mpg123_handle *mh;
+	struct stat st;
+	off_t *offsets, *copy = NULL;
+	off_t step;
+	size_t fill;
+	char *dup = NULL;
+	int err, found;
+
+	if (stat(path, &st) != 0)
+		return;
+
+	pthread_mutex_lock(&g_seek_lock);
+	found = seek_index_find(path, &st, NULL) != NULL;
+	pthread_mutex_unlock(&g_seek_lock);
+	if (found)
+		return;
+
+	pthread_once(&g_mpg123_once, mpg123_init_once);
+	if (g_mpg123_err != MPG123_OK)
+		return;
+	mh = mpg123_new(NULL, &err);
+	if (!mh)
+		return;
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0);
+	if (mpg123_open(mh, path) == MPG123_OK &&
+	    mpg123_scan(mh) == MPG123_OK &&
+	    mpg123_index(mh, &offsets, &step, &fill) == MPG123_OK &&
+	    fill > 0) {
+		copy = malloc(fill * sizeof(*offsets));
+		dup = strdup(path);
+		if (copy)
+			memcpy(copy, offsets, fill * sizeof(*offsets));
+	}
+	mpg123_close(mh);
+	mpg123_delete(mh);
+	if (!copy || !dup) {
+		free(copy);
+		free(dup);
+		return;
+	}
+
+	pthread_mutex_lock(&g_seek_lock);
+	if (seek_index_find(path, &st, &victim)) {
+		free(copy);
+		free(dup);
+	} else {
+		seek_index_clear(victim);
+		victim->path = dup;
+		victim->offsets = copy;
+		victim->step = step;
+		victim->fill = fill;
+		victim->size = (int64_t)st.st_size;
+		victim->mtime = (int64_t)st.st_mtime;
+		victim->used = ++g_seek_clock;
+	}
+	pthread_mutex_unlock(&g_seek_lock);
+}
+
+/* Hand mh the index of path if there is one yet; 0 if it got it. */
+static int seek_index_apply(mpg123_handle *mh, const char *path)
+{
+	struct seek_index *ix;
+	struct stat st;
+	int ret = -1;
+
+	if (stat(path, &st) != 0)
+		return -1;
+
+	pthread_mutex_lock(&g_seek_lock);
+	ix = seek_index_find(path, &st, NULL);
+	if (ix && mpg123_set_index(mh, ix->offsets, ix->step,
+				   ix->fill) == MPG123_OK)
+		ret = 0;
+	pthread_mutex_unlock(&g_seek_lock);
+	return ret;
+}
+
+static void seek_index_free(void)
+{
+	int i;
+
+	pthread_mutex_lock(&g_seek_lock);
+	for (i = 0; i < SEEK_INDEX_SLOTS; i++)
+		seek_index_clear(&g_seek_index[i]);
+	pthread_mutex_unlock(&g_seek_lock);
+}
+
+/* Size the ring and start the decoder; 0 on success. */
+static int decoder_start(void)
+{
+	size_t want, size = 4096;
+
+	want = (size_t)g_dev_rate * (size_t)g_dev_frame_bytes * RING_MS / 1000;
+	while (size < want || size < 4 * DECODE_CHUNK)
+		size *= 2;
+
+	g_ring.buf = malloc(size);
+	if (!g_ring.buf)
+		return -1;
+	g_ring.size = size;
+
+	/*
+	 * Nothing is hooked to the device yet.  Start the counters over, so
+	 * a smaller ring than last time sees no stale fill, and drop any
+	 * flush the old callback never got to.
+	 */
+	atomic_store(&g_ring.write, 0);
+	atomic_store(&g_ring.read, 0);
+	atomic_store(&g_ring.mark_w, 0);
+	atomic_store(&g_ring.mark_r, 0);
+	atomic_store(&g_flush_to, 0);
+	atomic_store(&g_flush_mark, 0);
+	atomic_store(&g_flush_frames, 0);
+	atomic_store(&g_flush_seq, 0);
+	g_flush_seen = 0;
+
+	g_dec_stop = 0;
+	if (pthread_create(&g_decoder, NULL, decoder_main, NULL) != 0) {
+		free(g_ring.buf);
+		g_ring.buf = NULL;
+		return -1;
+	}
+	g_decoder_started = 1;
+	return 0;
+}
+
+static void decoder_stop(void)
+{
+	if (!g_decoder_started)
+		return;
+
+	pthread_mutex_lock(&g_dec_lock);
+	g_dec_stop = 1;
+	pthread_cond_signal(&g_dec_cond);
+	pthread_mutex_unlock(&g_dec_lock);
+	pthread_join(g_decoder, NULL);
+	g_decoder_started = 0;
+
+	free(g_ring.buf);
+	g_ring.buf = NULL;
+}
+
+/* What the device was asked for; g_dev_* is what it gave us. */
+static AudioConfig g_audio;
+
+/*
+ * Open the device at @rate with the configured format and buffer, and
+ * start the decoder for it.  Nothing may be loaded.
+ */
+static int audio_open(int rate)
+{
+	Uint16 format;
+
+	format = g_audio.format == AUDIO_FORMAT_F32 ? AUDIO_F32SYS
+						    : AUDIO_S16SYS;
+	if (Mix_OpenAudio(rate, format, 2, g_audio.buffer) < 0)
+		return -1;
+
+	if (!Mix_QuerySpec(&g_dev_rate, &format, &g_dev_channels)) {
+		Mix_CloseAudio();
+		g_dev_rate = 0;
+		return -1;
+	}
+	g_dev_frame_bytes = SDL_AUDIO_BITSIZE(format) / 8 * g_dev_channels;
+	Mix_SetPostMix(music_postmix, NULL);
+	Mix_HookMusicFinished(music_finished);
+	Mix_VolumeMusic(atomic_load(&g_stream_volume));
+
+	/* Without a format mpg123 can produce, every file uses Mix_Music. */
+	g_dev_encoding = 0;
+	pthread_once(&g_mpg123_once, mpg123_init_once);
+	if (g_mpg123_err == MPG123_OK &&
+	    g_dev_channels >= 1 && g_dev_channels <= 2) {
+		if (format == AUDIO_S16SYS)
+			g_dev_encoding = MPG123_ENC_SIGNED_16;
+		else if (format == AUDIO_F32SYS)
+			g_dev_encoding = MPG123_ENC_FLOAT_32;
+	}
+	if (g_dev_encoding && decoder_start() != 0)
+		g_dev_encoding = 0;
+	return 0;
+}
+
+static void audio_close(void)
+{
+	Mix_HookMusic(NULL, NULL);
+	Mix_SetPostMix(NULL, NULL);
+	Mix_HookMusicFinished(NULL);
+	decoder_stop();
+	Mix_CloseAudio();
+	g_dev_rate = 0;
+}
+
+/* Sample rate an MP3 decodes to natively, or 0. */
+static long file_rate(const char *path)
+{
+	mpg123_handle *mh;
+	long rate = 0;
+	int channels, encoding, err;
+
+	mh = mpg123_new(NULL, &err);
+	if (!mh)
+		return 0;
+	mpg123_param(mh, MPG123_ADD_FLAGS, MPG123_QUIET, 0);
+	if (mpg123_open(mh, path) != MPG123_OK ||
+	    mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK)
+		rate = 0;
+	mpg123_close(mh);
+	mpg123_delete(mh);
+	return rate;
+}
+
+int player_init(const AudioConfig *audio)
 {
 	if (SDL_Init(SDL_INIT_AUDIO) < 0) {
 		fprintf(stderr, "Failed to initialize SDL: %s\n",
@@ -179,37 +1095,141 @@ int player_init(void)
 		return -1;
 	}
 
-	if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
+	g_music = NULL;
+	atomic_store(&g_music_running, 0);
+	atomic_store(&g_frames, 0);
+
+	g_audio = *audio;
+	if (audio_open(g_audio.rate) != 0) {
 		fprintf(stderr, "Failed to initialize SDL_mixer: %s\n",
 			Mix_GetError());
 		SDL_Quit();
 		return -1;
 	}
+	return 0;
+}
+
+/**
+ * player_set_audio() - reopen the device with new settings.
+ *
+ * Stops playback.  If the device refuses the new settings the old ones
+ * are restored.
+ *
+ * Return: 0 if the settings are in effect (or unchanged), -1 otherwise.
+ */
+int player_set_audio(const AudioConfig *audio)
+{
+	AudioConfig old = g_audio;
+
+	if (audio->rate == g_audio.rate && audio->buffer == g_audio.buffer &&
+	    audio->format == g_audio.format &&
+	    audio->native_rate == g_audio.native_rate && g_dev_rate)
+		return 0;
+
+	player_stop();
+	if (g_music) {
+		Mix_FreeMusic(g_music);
+		g_music = NULL;
+	}
+	if (g_dev_rate)
+		audio_close();
 
-	g_music = NULL;
-	g_start_ticks = 0;
-	g_paused_ticks = 0;
+	g_audio = *audio;
+	if (audio_open(g_audio.rate) == 0)
+		return 0;
 
-	return 0;
+	g_audio = old;
+	audio_open(g_audio.rate);
+	return -1;
+}
+
+/* Rate the device is actually running at, 0 if it is closed. */
+int player_device_rate(void)
+{
+	return g_dev_rate;
+}
+
+int audio_format_from_name(const char *name)
+{
+	if (!name)
+		return -1;
+	if (strcasecmp(name, "s16") == 0)
+		return AUDIO_FORMAT_S16;
+	if (strcasecmp(name, "f32") == 0)
+		return AUDIO_FORMAT_F32;
+	return -1;
+}
+
+const char *audio_format_name(int format)
+{
+	return format == AUDIO_FORMAT_F32 ? "f32" : "s16";
 }
 
 void player_shutdown(void)
 {
+	stream_stop();
+	seek_index_free();
 	if (g_music) {
 		Mix_FreeMusic(g_music);
 		g_music = NULL;
 	}
-	Mix_CloseAudio();
+	if (g_dev_rate)
+		audio_close();
 	SDL_Quit();
 }
 
 int player_load_file(const char *filename)
 {
+	struct stream s, cur, next;
+	long rate;
+
+	stream_stop();
+	atomic_store(&g_music_running, 0);
+	Mix_HaltMusic();
+	atomic_store(&g_frames, 0);
 	if (g_music) {
 		Mix_FreeMusic(g_music);
 		g_music = NULL;
 	}
 
+	/* Native mode: run the device at the file's rate, no resampling. */
+	if (g_audio.native_rate && has_mp3_ext(filename)) {
+		rate = file_rate(filename);
+		if (rate > 0 && rate != g_dev_rate) {
+			if (g_dev_rate)
+				audio_close();
+			if (audio_open((int)rate) != 0 &&
+			    audio_open(g_audio.rate) != 0)
+				return -1;
+		}
+	}
+	if (!g_dev_rate)
+		return -1;
+
+	if (g_dev_encoding && has_mp3_ext(filename) &&
+	    stream_open(&s, filename) == 0) {
+		Mix_HookMusic(stream_mix, NULL);
+
+		pthread_mutex_lock(&g_dec_lock);
+		cur = g_cur;
+		next = g_next;
+		g_cur = s;
+		memset(&g_next, 0, sizeof(g_next));
+		ring_flush(0);
+		atomic_store(&g_stream_paused, 1);	/* until player_play() */
+		atomic_store(&g_streaming, 1);
+		pthread_cond_signal(&g_dec_cond);
+		pthread_mutex_unlock(&g_dec_lock);
+
+		stream_close(&cur);
+		stream_close(&next);
+
+		/* Index it in the background, before anyone seeks. */
+		probe_submit_index(filename);
+		return 0;
+	}
+
+	Mix_HookMusic(NULL, NULL);
 	g_music = Mix_LoadMUS(filename);
 	if (!g_music) {
 		fprintf(stderr, "Failed to load MP3 file '%s': %s\n", filename,
@@ -220,24 +1240,161 @@ int player_load_file(const char *filename)
 	return 0;
 }
 
+/**
+ * player_queue_next() - open the track to play after the current one.
+ *
+ * Only works while an MP3 is playing through the decoder; it then moves
+ * on to this track without a gap and player_take_switch() reports the
+ * switch once it is heard.  Replaces any previously queued track.
+ *
+ * Return: 0 if queued, -1 if the caller has to start it when the current
+ * track stops.
+ */
+int player_queue_next(const char *filename)
+{
+	struct stream s, old;
+
+	if (!g_dev_encoding || !has_mp3_ext(filename) ||
+	    !atomic_load(&g_streaming))
+		return -1;
+
+	/* Would have to be resampled; let it reopen the device instead. */
+	if (g_audio.native_rate && file_rate(filename) != g_dev_rate)
+		return -1;
+
+	if (stream_open(&s, filename) != 0)
+		return -1;
+
+	pthread_mutex_lock(&g_dec_lock);
+	/* The decoder already reached the end: too late. */
+	if (!g_cur.mh) {
+		pthread_mutex_unlock(&g_dec_lock);
+		stream_close(&s);
+		return -1;
+	}
+	old = g_next;
+	g_next = s;
+	pthread_mutex_unlock(&g_dec_lock);
+
+	stream_close(&old);
+	return 0;
+}
+
+void player_clear_next(void)
+{
+	struct stream old;
+
+	pthread_mutex_lock(&g_dec_lock);
+	old = g_next;
+	memset(&g_next, 0, sizeof(g_next));
+	pthread_mutex_unlock(&g_dec_lock);
+
+	stream_close(&old);
+}
+
+/* Return: non-zero once per switch to a queued track. */
+int player_take_switch(void)
+{
+	static unsigned seen;
+	unsigned switches = atomic_load(&g_switches);
+
+	if (switches == seen)
+		return 0;
+	seen = switches;
+	return 1;
+}
+
+/* Times the audio callback found the decoder behind. */
+unsigned long player_underruns(void)
+{
+	return atomic_load(&g_underruns);
+}
+
+/**
+ * player_seek() - jump to @seconds into the current track.
+ *
+ * The ring is flushed and the position restarts at the frame mpg123
+ * actually landed on, so player_get_current_position() stays exact.
+ * Seeking past the end ends the track the usual way, including a switch
+ * to the queued one.
+ *
+ * Return: 0 on success, -1 if nothing seekable is playing (or the decoder
+ * is already past the end of what is being heard).
+ */
+int player_seek(double seconds)
+{
+	char *path = NULL;
+	off_t frame;
+	int ret = -1, indexed = 0;
+
+	if (seconds < 0.0)
+		seconds = 0.0;
+
+	if (!atomic_load(&g_streaming)) {
+		if (!g_music || Mix_SetMusicPosition(seconds) != 0)
+			return -1;
+		atomic_store(&g_frames, (uint64_t)(seconds * g_dev_rate));
+		return 0;
+	}
+
+	pthread_mutex_lock(&g_dec_lock);
+	if (g_cur.path)
+		path = strdup(g_cur.path);
+	pthread_mutex_unlock(&g_dec_lock);
+	if (!path)
+		return -1;
+
+	pthread_mutex_lock(&g_dec_lock);
+	/*
+	 * A pending marker means the track being heard is no longer the one
+	 * being decoded; so does a different path (the UI loaded another).
+	 */
+	if (!g_cur.mh || strcmp(g_cur.path, path) != 0 ||
+	    atomic_load(&g_ring.mark_w) != atomic_load(&g_ring.mark_r))
+		goto out;
+
+	indexed = seek_index_apply(g_cur.mh, path) == 0;
+	frame = mpg123_seek(g_cur.mh, (off_t)(seconds * g_dev_rate), SEEK_SET);
+	if (frame < 0)
+		goto out;
+
+	g_cur.eof = 0;
+	ring_flush((uint64_t)frame);
+	atomic_store(&g_frames, (uint64_t)frame);
+	pthread_cond_signal(&g_dec_cond);
+	ret = 0;
+out:
+	pthread_mutex_unlock(&g_dec_lock);
+	/* Normally queued when the track was loaded; in case that failed. */
+	if (ret == 0 && !indexed)
+		probe_submit_index(path);
+	free(path);
+	return ret;
+}
+
 void player_play(void)
 {
 	if (g_music) {
-		Mix_PlayMusic(g_music, 1);
-		g_start_ticks = SDL_GetTicks();
-		g_paused_ticks = 0;
+		if (Mix_PlayMusic(g_music, 1) == 0)
+			atomic_store(&g_music_running, 1);
+	} else {
+		atomic_store(&g_stream_paused, 0);
 	}
 }
 
 void player_pause_toggle(void)
 {
+	if (atomic_load(&g_streaming)) {
+		atomic_store(&g_stream_paused, !atomic_load(&g_stream_paused));
+		return;
+	}
+
 	if (Mix_PlayingMusic() || Mix_PausedMusic()) {
 		if (Mix_PausedMusic()) {
 			Mix_ResumeMusic();
-			g_start_ticks = SDL_GetTicks() - g_paused_ticks;
-			g_paused_ticks = 0;
+			atomic_store(&g_music_running, 1);
 		} else {
-			g_paused_ticks = SDL_GetTicks() - g_start_ticks;
+			atomic_store(&g_music_running, 0);
 			Mix_PauseMusic();
 		}
 	}
@@ -245,18 +1402,23 @@ void player_pause_toggle(void)
 
 void player_stop(void)
 {
+	stream_stop();
+	atomic_store(&g_music_running, 0);
 	Mix_HaltMusic();
-	g_start_ticks = 0;
-	g_paused_ticks = 0;
+	atomic_store(&g_frames, 0);
 }
 
 int player_is_playing(void)
 {
-	return Mix_PlayingMusic() || Mix_PausedMusic();
+	return atomic_load(&g_streaming) || Mix_PlayingMusic() ||
+	       Mix_PausedMusic();
 }
 
 PlayerStatus player_get_status(void)
 {
+	if (atomic_load(&g_streaming))
+		return atomic_load(&g_stream_paused) ? PLAYER_PAUSED
+						     : PLAYER_PLAYING;
 	if (Mix_PausedMusic())
 		return PLAYER_PAUSED;
 	if (Mix_PlayingMusic())
@@ -264,15 +1426,13 @@ PlayerStatus player_get_status(void)
 	return PLAYER_STOPPED;
 }
 
+/* Lock-free; cheap enough to call on every redraw. */
 double player_get_current_position(void)
 {
-	if (!player_is_playing() && !Mix_PausedMusic())
+	if (g_dev_rate <= 0)
 		return 0.0;
-
-	if (Mix_PausedMusic())
-		return (double)g_paused_ticks / 1000.0;
-
-	return (double)(SDL_GetTicks() - g_start_ticks) / 1000.0;
+	return (double)atomic_load_explicit(&g_frames, memory_order_relaxed) /
+	       g_dev_rate;
 }
 
 double get_mp3_duration(const char *filename)
@@ -284,16 +1444,17 @@ double get_mp3_duration(const char *filename)
 	int channels, encoding;
 	off_t num_samples;
 
-	static int mpg123_initialized;
+	/* Most files say how long they are in their first frame. */
+	duration = mp3_header_duration(filename);
+	if (duration > 0)
+		return duration;
 
-	if (!mpg123_initialized) {
-		err = mpg123_init();
-		if (err != MPG123_OK) {
-			fprintf(stderr, "Failed to initialize mpg123: %s\n",
-				mpg123_plain_strerror(err));
-			return -1.0;
-		}
-		mpg123_initialized = 1;
+	/* Called from the probe thread as well as the UI thread. */
+	pthread_once(&g_mpg123_once, mpg123_init_once);
+	if (g_mpg123_err != MPG123_OK) {
+		fprintf(stderr, "Failed to initialize mpg123: %s\n",
+			mpg123_plain_strerror(g_mpg123_err));
+		return -1.0;
 	}
 
 	mh = mpg123_new(NULL, &err);
@@ -361,39 +1522,6 @@ static void strip_mp3_ext(const char *fname, char *out, size_t outlen)
 	out[n] = '\0';
 }
 
-/* Join dir and name into dst. */
-static void join_path(char *dst, size_t dstsz, const char *dir, const char *name)
-{
-	size_t len = strlen(dir);
-
-	if (len > 0 && dir[len - 1] == '/')
-		snprintf(dst, dstsz, "%s%s", dir, name);
-	else
-		snprintf(dst, dstsz, "%s/%s", dir, name);
-}
-
-static int track_name_exists(const AppState *state, const char *name)
-{
-	int i;
-
-	for (i = 0; i < state->track_count; i++) {
-		if (strcmp(state->library[i].name, name) == 0)
-			return 1;
-	}
-	return 0;
-}
-
-static int track_path_exists(const AppState *state, const char *path)
-{
-	int i;
-
-	for (i = 0; i < state->track_count; i++) {
-		if (strcmp(state->library[i].path, path) == 0)
-			return 1;
-	}
-	return 0;
-}
-
 /* Function that removes spaces from a string. */
 static void remove_spaces(char *str) {
 	char *write_ptr = str;
@@ -410,85 +1538,314 @@ static void remove_spaces(char *str) {
 }
 
 /**
- * addfolder() - add all *.mp3 files from a directory into library.
+ * addfolder() - start importing all *.mp3 files below a directory.
+ *
+ * The tree is walked in the background by the scanner; addfolder_poll()
+ * reports progress and merges the result into the library when the walk
+ * is done.
+ *
+ * Return: 0 if the import was started, -1 otherwise (state->message says
+ * why).
  */
-void addfolder(AppState *state, const char *dirpath)
+int addfolder(AppState *state, const char *dirpath)
 {
-	DIR *dir;
-	struct dirent *de;
-	int added = 0, skipped_exists = 0, skipped_cap = 0, skipped_invalid = 0;
+	struct scan_status st;
+	int fd;
 
 	if (!dirpath || !*dirpath) {
 		snprintf(state->message, sizeof(state->message),
 			 "Usage: addfolder <directory_path>");
-		return;
+		return -1;
+	}
+
+	if (scanner_status(&st)) {
+		snprintf(state->message, sizeof(state->message),
+			 "addfolder: another import is still running ('cancel' stops it)");
+		return -1;
 	}
 
-	dir = opendir(dirpath);
-	if (!dir) {
+	fd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
 		snprintf(state->message, sizeof(state->message),
 			 "addfolder: cannot open '%s': %s",
 			 dirpath, strerror(errno));
-		return;
+		return -1;
 	}
+	close(fd);
 
-	while ((de = readdir(dir)) != NULL) {
-		char fullpath[512];
-		struct stat st;
-		char track_name[50];
+	if (scanner_start(dirpath, has_mp3_ext) != 0) {
+		snprintf(state->message, sizeof(state->message),
+			 "addfolder: cannot start scanning '%s'", dirpath);
+		return -1;
+	}
 
-		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
-			continue;
+	snprintf(state->message, sizeof(state->message),
+		 "addfolder: scanning '%s'...", dirpath);
+	return 0;
+}
 
-		if (!has_mp3_ext(de->d_name))
-			continue;
+/**
+ * library_import_file() - add an audio file found on disk to the library.
+ * @name_off: where the file name starts in @fullpath.
+ *
+ * The track is named after the file, minus its extension, and journaled.
+ *
+ * Return: the new library index, IMPORT_EXISTS if a track with that name
+ * or path is already there, IMPORT_INVALID for an unusable path, or
+ * IMPORT_NOMEM.
+ */
+int library_import_file(AppState *state, const char *fullpath,
+			size_t name_off)
+{
+	char track_name[NAME_MAX + 1];
+	int idx;
 
-		join_path(fullpath, sizeof(fullpath), dirpath, de->d_name);
+	/* Too long to be played by that name. */
+	if (strlen(fullpath) >= sizeof(state->current_track))
+		return IMPORT_INVALID;
 
-		if (stat(fullpath, &st) != 0 || !S_ISREG(st.st_mode)) {
-			skipped_invalid++;
-			continue;
-		}
+	strip_mp3_ext(fullpath + name_off, track_name, sizeof(track_name));
+	if (track_name[0] == '\0')
+		return IMPORT_INVALID;
+
+	if (library_find_by_name(state, track_name) >= 0 ||
+	    library_find_by_path(state, fullpath) >= 0)
+		return IMPORT_EXISTS;
+
+	remove_spaces(track_name);
+
+	idx = library_add_track(state, track_name, fullpath, 0);
+	if (idx < 0)
+		return IMPORT_NOMEM;
+	journal_log_add(state, idx);
+	return idx;
+}
+
+/*
+ * Add the files found by a finished scan.  They arrive sorted by path, so
+ * the library order does not depend on which worker found what first.
+ */
+static void addfolder_merge(AppState *state, struct scan_file *files,
+			    size_t count, unsigned long errors)
+{
+	int added = 0, skipped_exists = 0, skipped_cap = 0;
+	unsigned long skipped_invalid = errors;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		int r = library_import_file(state, files[i].path,
+					    files[i].name_off);
 
-		if (ensure_library_capacity(state, 1) != 0) {
+		if (r == IMPORT_INVALID) {
+			skipped_invalid++;
+		} else if (r == IMPORT_EXISTS) {
+			skipped_exists++;
+		} else if (r == IMPORT_NOMEM) {
 			/* ENOMEM or overflow */
 			skipped_cap++;
 			break;
+		} else {
+			added++;
 		}
+	}
 
-		strip_mp3_ext(de->d_name, track_name, sizeof(track_name));
-		if (track_name[0] == '\0') {
-			skipped_invalid++;
-			continue;
-		}
+	snprintf(state->message, sizeof(state->message),
+		 "addfolder: added %d, skipped (exists %d, alloc_fail %d, invalid %lu)",
+		 added, skipped_exists, skipped_cap, skipped_invalid);
+}
 
-		if (track_name_exists(state, track_name) ||
-		    track_path_exists(state, fullpath)) {
-			skipped_exists++;
-			continue;
-		}
+/**
+ * addfolder_poll() - report on or finish a running addfolder.
+ *
+ * Called from the main loop.
+ *
+ * Return: 1 while an import is in progress, 0 otherwise.
+ */
+int addfolder_poll(AppState *state)
+{
+	struct scan_status st;
+	struct scan_file *files;
+	size_t count;
 
-		remove_spaces(track_name);
+	if (!scanner_status(&st))
+		return 0;
 
-		strncpy(state->library[state->track_count].name, track_name,
-			sizeof(state->library[state->track_count].name) - 1);
-		state->library[state->track_count].name[
-			sizeof(state->library[state->track_count].name) - 1] = '\0';
+	if (!st.done) {
+		snprintf(state->message, sizeof(state->message),
+			 "addfolder: %s %lu folders, %lu tracks found ('cancel' stops it)",
+			 st.cancelled ? "cancelling..." : "scanning...",
+			 st.dirs, st.files);
+		return 1;
+	}
 
-		strncpy(state->library[state->track_count].path, fullpath,
-			sizeof(state->library[state->track_count].path) - 1);
-		state->library[state->track_count].path[
-			sizeof(state->library[state->track_count].path) - 1] = '\0';
+	files = scanner_collect(&count);
+	if (st.cancelled)
+		snprintf(state->message, sizeof(state->message),
+			 "addfolder: cancelled after %lu folders, nothing added",
+			 st.dirs);
+	else
+		addfolder_merge(state, files, count, st.errors);
+	scanner_free_files(files, count);
+	return 0;
+}
 
-		state->track_count++;
-		added++;
-	}
-	closedir(dir);
+/* Return: 0 if an import was running and has been asked to stop. */
+int addfolder_cancel(AppState *state)
+{
+	struct scan_status st;
 
-	config_save(state);
+	if (!scanner_status(&st) || st.done)
+		return -1;
 
+	scanner_cancel();
 	snprintf(state->message, sizeof(state->message),
-		 "addfolder: added %d, skipped (exists %d, alloc_fail %d, invalid %d)",
-		 added, skipped_exists, skipped_cap, skipped_invalid);
+		 "addfolder: cancelling...");
+	return 0;
+}
+
+/* =========================
+ * Webdownload jobs
+ * ========================= */
+
+static void webdownload_event(const struct job_info *job, const char *path,
+			      void *arg)
+{
+	AppState *state = arg;
+	const char *slash;
+	int idx;
+
+	if (path) {
+		slash = strrchr(path, '/');
+		idx = library_import_file(state, path,
+					  slash ? (size_t)(slash - path + 1) : 0);
+		if (idx >= 0)
+			snprintf(state->message, sizeof(state->message),
+				 "webdownload #%d: added '%s'", job->id,
+				 library_name(state, idx));
+		return;
+	}
+
+	if (job->state == JOB_DONE)
+		snprintf(state->message, sizeof(state->message),
+			 "webdownload #%d '%s' finished, %d track(s)",
+			 job->id, job->query, job->files);
+	else
+		snprintf(state->message, sizeof(state->message),
+			 "webdownload #%d '%s' failed (exit %d): %s", job->id,
+			 job->query, job->exit_code, job->last_line);
 }
 
+/**
+ * webdownload_poll() - import what download jobs have finished so far.
+ *
+ * Called from the main loop.  Each downloaded file is added on its own
+ * as soon as spotdl reports it, without rescanning the download folder.
+ *
+ * Return: the number of jobs still running.
+ */
+int webdownload_poll(AppState *state)
+{
+	return jobs_poll(webdownload_event, state);
+}
+
+/* =========================
+ * Duration cache
+ * ========================= */
+
+/* Top the probe queue back up to FILL once it drops below LOW. */
+#define PROBE_QUEUE_LOW		256
+#define PROBE_QUEUE_FILL	1024
+
+/**
+ * library_cached_duration() - duration of path for play_track().
+ *
+ * Uses the value cached on the library track if the file still has the
+ * size and mtime it was measured at.  Otherwise returns 0 and asks the
+ * probe to measure it ahead of everything else; library_probe_poll() sets
+ * state->track_duration when the answer comes back.
+ */
+double library_cached_duration(AppState *state, const char *path)
+{
+	const Track *t = NULL;
+	struct stat st;
+	int i;
+
+	i = library_find_by_path(state, path);
+	if (i >= 0)
+		t = &state->library[i];
+
+	if (t && t->duration != 0.0 && stat(path, &st) == 0 &&
+	    (int64_t)st.st_size == t->size &&
+	    (int64_t)st.st_mtime == t->mtime)
+		return t->duration > 0.0 ? t->duration : 0.0;
+
+	probe_submit(t ? t->id : 0, path, 0, 0, 1);
+	return 0.0;
+}
+
+/**
+ * library_probe_poll() - apply probe results and keep the probe fed.
+ *
+ * Called from the main loop.  Every track in the library is handed to the
+ * probe once per session, a batch at a time; the probe only decodes files
+ * whose size or mtime changed.  New results are saved with the next
+ * config snapshot.
+ *
+ * Return: number of tracks whose cached duration changed.
+ */
+int library_probe_poll(AppState *state)
+{
+	struct probe_result *res;
+	char path[PATH_MAX];
+	size_t n, i, queued;
+	int changed = 0, idx;
+	Track *t;
+
+	res = probe_take(&n);
+	for (i = 0; i < n; i++) {
+		const struct probe_result *r = &res[i];
+
+		if (r->duration > 0.0 &&
+		    strcmp(r->path, state->current_track) == 0)
+			state->track_duration = r->duration;
+
+		idx = library_find_by_id(state, r->id);
+		if (idx < 0)
+			continue;
+		t = &state->library[idx];
+		if (!library_path_equals(state, idx, r->path))
+			continue;
+		if (t->duration == r->duration && t->size == r->size &&
+		    t->mtime == r->mtime)
+			continue;
+
+		t->duration = r->duration;
+		t->size = r->size;
+		t->mtime = r->mtime;
+		changed++;
+	}
+	probe_free_results(res, n);
+
+	if (changed)
+		config_mark_dirty(state);
+
+	if (g_probe_cursor > state->track_count)
+		g_probe_cursor = state->track_count;
+	if (g_probe_cursor == state->track_count)
+		return changed;
+
+	queued = probe_pending();
+	if (queued >= PROBE_QUEUE_LOW)
+		return changed;
+
+	while (g_probe_cursor < state->track_count &&
+	       queued < PROBE_QUEUE_FILL) {
+		t = &state->library[g_probe_cursor];
+		library_path(state, g_probe_cursor, path, sizeof(path));
+		if (probe_submit(t->id, path, t->size, t->mtime, 0) != 0)
+			break;
+		g_probe_cursor++;
+		queued++;
+	}
+	return changed;
+}
@@ -1,15 +1,29 @@
 #ifndef FUNCTIONS_H
 #define FUNCTIONS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef enum {
 	PLAYER_STOPPED,
 	PLAYER_PLAYING,
 	PLAYER_PAUSED
 } PlayerStatus;
 
-int player_init(void);
+struct AudioConfig;
+
+int player_init(const struct AudioConfig *audio);
+int player_set_audio(const struct AudioConfig *audio);
+int player_device_rate(void);
+int audio_format_from_name(const char *name);
+const char *audio_format_name(int format);
 void player_shutdown(void);
 int player_load_file(const char *filename);
+int player_queue_next(const char *filename);
+void player_clear_next(void);
+int player_take_switch(void);
+unsigned long player_underruns(void);
+int player_seek(double seconds);
 void player_play(void);
 void player_set_volume(int volume);
 void player_pause_toggle(void);
@@ -18,16 +32,45 @@ int player_is_playing(void);
 PlayerStatus player_get_status(void);
 double player_get_current_position(void);
 double get_mp3_duration(const char *filename);
+void seek_index_build(const char *path);
 
 struct AppState;
 struct Playlist;
 
-void addfolder(struct AppState *state, const char *dirpath);
+int addfolder(struct AppState *state, const char *dirpath);
+int addfolder_poll(struct AppState *state);
+int addfolder_cancel(struct AppState *state);
+int webdownload_poll(struct AppState *state);
+
+/* library_import_file() failures; >= 0 is the new library index */
+#define IMPORT_EXISTS	-1
+#define IMPORT_INVALID	-2
+#define IMPORT_NOMEM	-3
+
+int library_import_file(struct AppState *state, const char *fullpath,
+			size_t name_off);
+
+/* Duration cache (filled by the background probe) */
+double library_cached_duration(struct AppState *state, const char *path);
+int library_probe_poll(struct AppState *state);
 
 /* Dynamic array helpers */
-int ensure_library_capacity(struct AppState *state, int additional);
+int ensure_library_capacity(struct AppState *state, int additional,
+			    size_t string_bytes);
 int ensure_playlists_capacity(struct AppState *state, int additional);
 int ensure_playlist_tracks_capacity(struct Playlist *pl, int additional);
 void free_app_state(struct AppState *state);
 
+/* Library / playlist mutations (shared by commands and journal replay) */
+int library_add_track(struct AppState *state, const char *name,
+		      const char *path, uint64_t id);
+void library_remove_track(struct AppState *state, int idx);
+void library_set_current(struct AppState *state, const char *path);
+const char *library_current_name(const struct AppState *state);
+int library_rename_track(struct AppState *state, int idx, const char *name);
+int playlist_create(struct AppState *state, const char *name);
+void playlist_delete(struct AppState *state, int pidx);
+int playlist_append_track(struct AppState *state, int pidx, int track_idx);
+void playlist_remove_at(struct AppState *state, int pidx, int pos);
+
 #endif /* FUNCTIONS_H */
\ No newline at end of file
@@ -0,0 +1,437 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(LMP_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define LANES		16
+#elif !defined(LMP_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define LANES		8
+#else
+#define LANES		1
+#endif
+
+#include "fuzzy.h"
+#include "library_strings.h"
+#include "fold.h"
+
+#define SCORE_MATCH		16
+#define SCORE_GAP_START		3
+#define SCORE_GAP_EXTEND	1
+#define BONUS_BOUNDARY		8
+#define BONUS_CAMEL		7
+#define BONUS_CONSECUTIVE	4
+#define BONUS_FIRST_MULT	2
+
+/*
+ * Scores are int16_t with BIAS added, so every real score is positive and
+ * 0 means that no alignment ends at that position.  The vector code can
+ * then shift zeros in and use plain signed maxima.  With the query and
+ * name limits no sum comes near INT16_MAX, and the gap penalties of one
+ * name cannot add up to BIAS.
+ */
+#define BIAS			8192
+
+/* Cells before position 0, always 0, so j - 1 and j - 2 can be read. */
+#define GUARD			2
+#define ROW_LEN			(GUARD + FUZZY_NAME_MAX + LANES)
+
+enum { CLASS_DELIM, CLASS_LOWER, CLASS_UPPER, CLASS_DIGIT };
+
+/*
+ * The name being scored and the rows of the dynamic programme over it.
+ * Row i of m holds, for each position j, the best score of q[0..i] with
+ * q[i] matched at j.
+ */
+struct fuzzy {
+	unsigned char	 q[FUZZY_QUERY_MAX];
+	int		 qlen;
+	int16_t		*key;		/* the name's search key; -1 past the end */
+	int16_t		*bonus;
+	int16_t		*m;
+	int16_t		*next;
+	int16_t		*best;		/* running maximum of m[k] + k */
+	int16_t		*mem;
+};
+
+/* Bytes of multibyte UTF-8 characters count as lower case letters. */
+static int char_class(unsigned char c)
+{
+	if (c >= 'a' && c <= 'z')
+		return CLASS_LOWER;
+	if (c >= 'A' && c <= 'Z')
+		return CLASS_UPPER;
+	if (c >= '0' && c <= '9')
+		return CLASS_DIGIT;
+	return c >= 0x80 ? CLASS_LOWER : CLASS_DELIM;
+}
+
+static int16_t bonus_at(int prev, int cur)
+{
+	if (cur == CLASS_DELIM)
+		return 0;
+	if (prev == CLASS_DELIM)
+		return BONUS_BOUNDARY;
+	if ((prev == CLASS_LOWER && cur == CLASS_UPPER) ||
+	    (prev != CLASS_DIGIT && cur == CLASS_DIGIT))
+		return BONUS_CAMEL;
+	return 0;
+}
+
+#if LANES > 1
+
+#if LANES == 16
+typedef __m256i vec;
+#define v_load(p)	_mm256_loadu_si256((const __m256i *)(p))
+#define v_store(p, x)	_mm256_storeu_si256((__m256i *)(p), (x))
+#define v_set1(v)	_mm256_set1_epi16((int16_t)(v))
+#define v_zero()	_mm256_setzero_si256()
+#define v_and		_mm256_and_si256
+#define v_add		_mm256_add_epi16
+#define v_sub		_mm256_sub_epi16
+#define v_mul		_mm256_mullo_epi16
+#define v_max		_mm256_max_epi16
+#define v_gt		_mm256_cmpgt_epi16
+#define v_eq		_mm256_cmpeq_epi16
+
+/* Every lane set to the last lane of the 128-bit half picked by sel. */
+static inline vec v_last_of(vec x, int sel)
+{
+	vec t = sel ? _mm256_permute2x128_si256(x, x, 0x11)
+		    : _mm256_permute2x128_si256(x, x, 0x08);
+
+	t = _mm256_shufflehi_epi16(t, 0xff);
+	return _mm256_unpackhi_epi64(t, t);
+}
+
+/*
+ * Running maximum across the lanes of x, continuing from *carry, which
+ * is then set to its last lane.  The shifts only move within each 128-bit
+ * half, so the low half's maximum is carried into the high one after.
+ */
+static inline vec v_scan(vec x, vec *carry)
+{
+	x = v_max(x, _mm256_slli_si256(x, 2));
+	x = v_max(x, _mm256_slli_si256(x, 4));
+	x = v_max(x, _mm256_slli_si256(x, 8));
+	x = v_max(x, v_last_of(x, 0));		/* low half, or 0 */
+	x = v_max(x, *carry);
+	*carry = v_last_of(x, 1);
+	return x;
+}
+#else
+typedef __m128i vec;
+#define v_load(p)	_mm_loadu_si128((const __m128i *)(p))
+#define v_store(p, x)	_mm_storeu_si128((__m128i *)(p), (x))
+#define v_set1(v)	_mm_set1_epi16((int16_t)(v))
+#define v_zero()	_mm_setzero_si128()
+#define v_and		_mm_and_si128
+#define v_add		_mm_add_epi16
+#define v_sub		_mm_sub_epi16
+#define v_mul		_mm_mullo_epi16
+#define v_max		_mm_max_epi16
+#define v_gt		_mm_cmpgt_epi16
+#define v_eq		_mm_cmpeq_epi16
+
+/* Running maximum across the lanes of x; see the AVX2 version. */
+static inline vec v_scan(vec x, vec *carry)
+{
+	vec t;
+
+	x = v_max(x, _mm_slli_si128(x, 2));
+	x = v_max(x, _mm_slli_si128(x, 4));
+	x = v_max(x, _mm_slli_si128(x, 8));
+	x = v_max(x, *carry);
+	t = _mm_shufflehi_epi16(x, 0xff);
+	*carry = _mm_unpackhi_epi64(t, t);
+	return x;
+}
+#endif
+
+static const int16_t lane_index[16] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+static void row_first(struct fuzzy *fz, int n)
+{
+	vec q = v_set1(fz->q[0]);
+	vec base = v_set1(BIAS + SCORE_MATCH);
+	vec mult = v_set1(BONUS_FIRST_MULT);
+	vec s;
+	int j;
+
+	for (j = 0; j < n; j += LANES) {
+		s = v_add(base, v_mul(v_load(fz->bonus + j), mult));
+		v_store(fz->m + j, v_and(v_eq(v_load(fz->key + j), q), s));
+	}
+}
+
+static void row_scan(struct fuzzy *fz, int n)
+{
+	vec zero = v_zero(), carry = v_zero();
+	vec ext = v_set1(SCORE_GAP_EXTEND);
+	vec k = v_mul(v_load(lane_index), ext);
+	vec step = v_set1(LANES * SCORE_GAP_EXTEND);
+	vec x;
+	int j;
+
+	for (j = 0; j < n; j += LANES) {
+		x = v_load(fz->m + j);
+		x = v_and(v_gt(x, zero), v_add(x, k));
+		v_store(fz->best + j, v_scan(x, &carry));
+		k = v_add(k, step);
+	}
+}
+
+static void row_next(struct fuzzy *fz, int i, int n)
+{
+	vec zero = v_zero();
+	vec q = v_set1(fz->q[i]);
+	vec cons = v_set1(BONUS_CONSECUTIVE);
+	vec match = v_set1(SCORE_MATCH);
+	vec ext = v_set1(SCORE_GAP_EXTEND);
+	vec step = v_set1(LANES * SCORE_GAP_EXTEND);
+	/* What a gap from k <= j - 2 costs, less the k in best[k]. */
+	vec gap = v_add(v_set1(SCORE_GAP_START - 2 * SCORE_GAP_EXTEND),
+			v_mul(v_load(lane_index), ext));
+	vec pm, pb, c, g, b, hit;
+	int j;
+
+	for (j = 0; j < n; j += LANES) {
+		pm = v_load(fz->m + j - 1);
+		pb = v_load(fz->best + j - 2);
+		c = v_and(v_gt(pm, zero), v_add(pm, cons));
+		g = v_and(v_gt(pb, zero), v_sub(pb, gap));
+		b = v_max(c, g);
+		hit = v_and(v_eq(v_load(fz->key + j), q), v_gt(b, zero));
+		b = v_add(v_add(b, match), v_load(fz->bonus + j));
+		v_store(fz->next + j, v_and(hit, b));
+		gap = v_add(gap, step);
+	}
+}
+
+#else
+
+static void row_first(struct fuzzy *fz, int n)
+{
+	int j;
+
+	for (j = 0; j < n; j++)
+		fz->m[j] = fz->key[j] == fz->q[0] ?
+			   BIAS + SCORE_MATCH + BONUS_FIRST_MULT * fz->bonus[j] :
+			   0;
+}
+
+static void row_scan(struct fuzzy *fz, int n)
+{
+	int run = 0, j;
+
+	for (j = 0; j < n; j++) {
+		if (fz->m[j] && fz->m[j] + j * SCORE_GAP_EXTEND > run)
+			run = fz->m[j] + j * SCORE_GAP_EXTEND;
+		fz->best[j] = (int16_t)run;
+	}
+}
+
+static void row_next(struct fuzzy *fz, int i, int n)
+{
+	int c, g, j;
+
+	for (j = 0; j < n; j++) {
+		c = fz->m[j - 1] ? fz->m[j - 1] + BONUS_CONSECUTIVE : 0;
+		g = fz->best[j - 2] ? fz->best[j - 2] - SCORE_GAP_START -
+				      (j - 2) * SCORE_GAP_EXTEND : 0;
+		if (g > c)
+			c = g;
+		fz->next[j] = fz->key[j] == fz->q[i] && c > 0 ?
+			      (int16_t)(c + SCORE_MATCH + fz->bonus[j]) : 0;
+	}
+}
+
+#endif
+
+/*
+ * The quick test most names fail: are the query's bytes in the key, in
+ * order?  Return: the key's length, as far as it is scored, or -1 if not.
+ */
+static int key_match(const struct fuzzy *fz, const char *key)
+{
+	const char *p = key, *end = key + strnlen(key, FUZZY_NAME_MAX);
+	int i;
+
+	for (i = 0; i < fz->qlen; i++) {
+		p = memchr(p, fz->q[i], (size_t)(end - p));
+		if (!p)
+			return -1;
+		p++;
+	}
+	return (int)(end - key);
+}
+
+/*
+ * Return: 1 with the name's best score and scored length in @hit, or 0 if
+ * it does not match.
+ */
+static int fuzzy_score(struct fuzzy *fz, const char *name, const char *key,
+		       struct fuzzy_hit *hit)
+{
+	const char *src;
+	int16_t *tmp;
+	int prev = CLASS_DELIM, cur, n, i, j, top = 0;
+
+	n = key_match(fz, key);
+	if (n < 0)
+		return 0;
+
+	/*
+	 * An ASCII name lines up with its key byte for byte, and still has
+	 * the capitals that camelCase humps are found by.
+	 */
+	for (j = 0; j < n && (unsigned char)name[j] < 0x80; j++)
+		;
+	src = j == n ? name : key;
+
+	for (j = 0; j < n; j++) {
+		cur = char_class((unsigned char)src[j]);
+		fz->key[j] = (unsigned char)key[j];
+		fz->bonus[j] = bonus_at(prev, cur);
+		prev = cur;
+	}
+	for (j = n; j < n + LANES; j++) {
+		fz->key[j] = -1;
+		fz->bonus[j] = 0;
+	}
+
+	row_first(fz, n);
+	for (i = 1; i < fz->qlen; i++) {
+		row_scan(fz, n);
+		row_next(fz, i, n);
+		tmp = fz->m;
+		fz->m = fz->next;
+		fz->next = tmp;
+	}
+
+	for (j = 0; j < n; j++) {
+		if (fz->m[j] > top)
+			top = fz->m[j];
+	}
+	hit->score = top - BIAS;
+	hit->len = n;
+	return 1;
+}
+
+/*
+ * Is a a better hit than b?  Ties go to the shorter name, then the earlier
+ * track.
+ */
+static int hit_better(const struct fuzzy_hit *a, const struct fuzzy_hit *b)
+{
+	if (a->score != b->score)
+		return a->score > b->score;
+	if (a->len != b->len)
+		return a->len < b->len;
+	return a->slot < b->slot;
+}
+
+/* h[0..n) is a heap with the worst hit on top. */
+static void heap_down(struct fuzzy_hit *h, int n, int i)
+{
+	struct fuzzy_hit tmp;
+	int c;
+
+	while ((c = 2 * i + 1) < n) {
+		if (c + 1 < n && hit_better(&h[c], &h[c + 1]))
+			c++;
+		if (!hit_better(&h[i], &h[c]))
+			break;
+		tmp = h[i];
+		h[i] = h[c];
+		h[c] = tmp;
+		i = c;
+	}
+}
+
+static void heap_up(struct fuzzy_hit *h, int i)
+{
+	struct fuzzy_hit hit = h[i];
+	int p;
+
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (!hit_better(&h[p], &hit))
+			break;
+		h[i] = h[p];
+		i = p;
+	}
+	h[i] = hit;
+}
+
+/**
+ * library_fuzzy_search() - the best @k fuzzy matches for @query.
+ * @hits:  room for @k hits; filled best first.
+ * @total: set to the number of names that matched at all.
+ *
+ * Only @k hits are ever kept, in a heap that drops the worst one as a
+ * better one comes along, so ranking the whole library costs no more
+ * memory than the screen needs.
+ *
+ * Return: the number of hits filled in, or -1 if out of memory.
+ */
+int library_fuzzy_search(const AppState *state, const char *query,
+			 struct fuzzy_hit *hits, int k, int *total)
+{
+	struct fuzzy fz;
+	struct fuzzy_hit hit;
+	char *key;
+	int n = 0, i;
+
+	*total = 0;
+	if (k <= 0)
+		return 0;
+	key = malloc(strlen(query) + 1);
+	if (!key)
+		return -1;
+	fz.qlen = (int)fold_key(query, key);
+	if (fz.qlen > FUZZY_QUERY_MAX)
+		fz.qlen = FUZZY_QUERY_MAX;
+	memcpy(fz.q, key, (size_t)fz.qlen);
+	free(key);
+	if (fz.qlen == 0)
+		return 0;
+
+	fz.mem = calloc(5 * ROW_LEN, sizeof(*fz.mem));
+	if (!fz.mem)
+		return -1;
+	fz.key = fz.mem + GUARD;
+	fz.bonus = fz.key + ROW_LEN;
+	fz.m = fz.bonus + ROW_LEN;
+	fz.next = fz.m + ROW_LEN;
+	fz.best = fz.next + ROW_LEN;
+
+	for (i = 0; i < state->track_count; i++) {
+		if (!fuzzy_score(&fz, library_name(state, i),
+				 library_key(state, i), &hit))
+			continue;
+		hit.slot = i;
+		(*total)++;
+
+		if (n < k) {
+			hits[n] = hit;
+			heap_up(hits, n++);
+		} else if (hit_better(&hit, &hits[0])) {
+			hits[0] = hit;
+			heap_down(hits, n, 0);
+		}
+	}
+	free(fz.mem);
+
+	/* Taking the worst off the top and putting it last sorts best first. */
+	for (i = n - 1; i > 0; i--) {
+		hit = hits[0];
+		hits[0] = hits[i];
+		hits[i] = hit;
+		heap_down(hits, i, 0);
+	}
+	return n;
+}
@@ -0,0 +1,33 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include "main.h"
+
+/*
+ * fzf-style fuzzy search over track names.
+ *
+ * A name matches when its search key (fold.h) holds the query's, byte by
+ * byte in order, whatever lies between them.  Of all the ways to line them
+ * up the best one gives the score: every matched character earns points,
+ * more at the start of a word or a camelCase hump and more again right
+ * after the previous match, and every skipped character costs some.
+ *
+ * The scoring runs along the name 8 (SSE2) or 16 (AVX2) positions at a
+ * time, or one at a time where neither is available or with LMP_NO_SIMD.
+ * Only the first FUZZY_QUERY_MAX bytes of the query's key and
+ * FUZZY_NAME_MAX bytes of a name's take part.
+ */
+
+#define FUZZY_QUERY_MAX		64
+#define FUZZY_NAME_MAX		1024
+
+struct fuzzy_hit {
+	int	slot;
+	int	score;
+	int	len;		/* of the name; the shorter one wins a tie */
+};
+
+int library_fuzzy_search(const AppState *state, const char *query,
+			 struct fuzzy_hit *hits, int k, int *total);
+
+#endif /* FUZZY_H */
@@ -2,6 +2,12 @@
 #include "config.h"
 #include "main.h"
 #include "functions.h" 
+#include "journal.h"
+#include "library_index.h"
+#include "library_strings.h"
+#include "search_index.h"
+#include "fuzzy.h"
+#include "jobs.h"
 #include <ctype.h>
 #include <dirent.h>
 #include <stdio.h>
@@ -10,12 +16,13 @@
 #include <string.h>
 #include <strings.h>   
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>    
 
 
 void cmd_add(AppState *state, const char *argument) {
-    char name[50] = {0};
-    char path[256] = {0};
+    char name[256] = {0};
+    char path[PATH_MAX] = {0};
 
     if (!argument || *argument == '\0') {
       snprintf(state->message, sizeof(state->message), "Usage: add <track_name> <file_path>");
@@ -75,99 +82,108 @@ void cmd_add(AppState *state, const char *argument) {
       return;
     }
 
-    if (ensure_library_capacity(state, 1) != 0) {
-      snprintf(state->message, sizeof(state->message),
-               "Error: cannot grow library (out of memory).");
-      return;
-    }
     if (access(path, F_OK) != 0) {
       snprintf(state->message, sizeof(state->message),
                "Error: File not found: %s", path);
       return;
     }
 
-    strncpy(state->library[state->track_count].name, name,
-            sizeof(state->library[state->track_count].name) - 1);
-    state->library[state->track_count]
-        .name[sizeof(state->library[state->track_count].name) - 1] = '\0';
-    strncpy(state->library[state->track_count].path, path,
-            sizeof(state->library[state->track_count].path) - 1);
-    state->library[state->track_count]
-        .path[sizeof(state->library[state->track_count].path) - 1] = '\0';
-    state->track_count++;
+    int idx = library_add_track(state, name, path, 0);
+    if (idx < 0) {
+      snprintf(state->message, sizeof(state->message),
+               "Error: cannot grow library (out of memory).");
+      return;
+    }
 
     snprintf(state->message, sizeof(state->message), "Added '%s' to library.",
              name);
 
-    config_save(state);
+    journal_log_add(state, idx);
 }
 
 void cmd_addfolder(AppState *state, const char *argument) {
     addfolder(state, argument);
 }
 
+void cmd_cancel(AppState *state) {
+    if (addfolder_cancel(state) != 0)
+      snprintf(state->message, sizeof(state->message), "Nothing to cancel.");
+}
+
 
 
 void cmd_webdownload(AppState *state, const char *argument) {
+    char download_target_dir[512];
+    char tmp_path[512];
+    const char *home = getenv("HOME");
+    int id;
+
     if (!argument || *argument == '\0') {
       snprintf(state->message, sizeof(state->message),
                "Usage: webdownload <track_name>");
-    } else {
-      char dl_command[1024];
-      char download_target_dir[512];
-      char safe_argument[256];
-      const char *home = getenv("HOME");
-
-      int j = 0;
-      for (int i = 0; argument[i] != '\0' && j < sizeof(safe_argument) - 1; i++) {
-        if (isalnum((unsigned char)argument[i]) || isspace((unsigned char)argument[i]) ||
-                argument[i] == '-' || argument[i] == '_' || argument[i] == '.') {
-                safe_argument[j++] = argument[i];
-            }
-      }
-      safe_argument[j] = '\0';
+      return;
+    }
+    if (!home) {
+      snprintf(state->message, sizeof(state->message),
+               "Could not find HOME directory.");
+      return;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s/LMP", home);
+    mkdir(tmp_path, 0755);
+    snprintf(download_target_dir, sizeof(download_target_dir),
+             "%s/LMP/downloads", home);
+    mkdir(download_target_dir, 0755);
 
-      if (safe_argument[0] == '\0') {
+    /* Runs without a shell, so the query needs no quoting or filtering. */
+    id = jobs_start_download(argument, download_target_dir);
+    if (id < 0) {
       snprintf(state->message, sizeof(state->message),
-               "Usage: webdownload <track_name>");
+               "Error starting the download. Is spotdl installed and "
+               "configured correctly?");
       return;
-      }
+    }
+    snprintf(state->message, sizeof(state->message),
+             "webdownload #%d: downloading '%s' in the background "
+             "('jobs' shows progress)", id, argument);
+}
 
-      if (home) {
-        snprintf(download_target_dir, sizeof(download_target_dir), "%s/LMP/downloads", home);
+void cmd_jobs(AppState *state) {
+    static const char *const states[] = {"running", "done", "failed"};
+    struct job_info jobs[JOBS_MAX];
+    size_t n = jobs_list(jobs, JOBS_MAX);
+    int rows, cols, line = 2;
 
-      {
-        char tmp_path[512];
-        snprintf(tmp_path, sizeof(tmp_path), "%s/LMP", home); mkdir(tmp_path, 0755);
-        snprintf(tmp_path, sizeof(tmp_path), "%s/LMP/downloads", home); mkdir(tmp_path, 0755);
-        mkdir(download_target_dir, 0755);
-      }
-        snprintf(dl_command, sizeof(dl_command),
-                 "spotdl download \"%s\" --output \"%s\"", safe_argument, download_target_dir);
+    getmaxyx(stdscr, rows, cols);
+    clear();
+    mvprintw(0, 2, "--- Download jobs ---");
 
-        snprintf(state->message, sizeof(state->message),
-                 "Downloading '%s'... please wait.", safe_argument);
-        draw_ui(state);
-        refresh();
+    if (n == 0)
+      mvprintw(line++, 2, "No downloads yet. Use: webdownload <track_name>");
 
-        fprintf(stderr, "DEBUG: Executing command: %s\n", dl_command);
-        
-        int result = system(dl_command);
+    for (size_t i = 0; i < n && line < rows - 2; i++) {
+      char pct[16] = "--";
 
-        if (result == 0) {
-          addfolder(state, download_target_dir);
-          snprintf(state->message, sizeof(state->message),
-                   "Finished downloading. '%s' added to library.", safe_argument);
-        } else {
-          snprintf(state->message, sizeof(state->message),
-                   "Error downloading track. Is spotdl installed and "
-                   "configured correctly?");
-        }
-      } else {
-        snprintf(state->message, sizeof(state->message),
-                 "Could not find HOME directory.");
-      }
-}
+      if (jobs[i].percent >= 0)
+        snprintf(pct, sizeof(pct), "%d%%", jobs[i].percent);
+      mvprintw(line++, 2, "#%-3d %-7s %4s  %d track(s)  %.*s", jobs[i].id,
+               states[jobs[i].state], pct, jobs[i].files, cols - 40,
+               jobs[i].query);
+      if (jobs[i].last_line[0] && line < rows - 2)
+        mvprintw(line++, 7, "%.*s", cols - 9, jobs[i].last_line);
+    }
+
+    attron(A_REVERSE);
+    mvprintw(rows - 1, 0, "Press any key to return");
+    attroff(A_REVERSE);
+
+    refresh();
+    timeout(-1);
+    getch();
+    timeout(0);
+
+    snprintf(state->message, sizeof(state->message),
+             "Returned from jobs view.");
 }
 
 void cmd_help(AppState *state, const char *argument) {
@@ -175,15 +191,21 @@ void cmd_help(AppState *state, const char *argument) {
                       "add \"<name>\" <path>       - Add track to library\n"
                       "rename <index> <new_name> - Rename a track in library by its index\n"
                       "remove / rm <name>        - Remove track from library\n"
-                      "addfolder <dir>           - Add all *.mp3 from dir (name=file sans .mp3)\n"
-                      "webdownload <track_name>  - Download via spotdl into LMP and import\n"
-                      "library / lib             - Show library & playlists\n"
-                      "search <promt>           - Search for tracks in library\n"
+                      "addfolder <dir>           - Add all *.mp3 below dir, recursively (name=file sans .mp3)\n"
+                      "cancel                    - Stop a running addfolder\n"
+                      "webdownload <track_name>  - Download via spotdl in the background and import\n"
+                      "jobs                      - Show download jobs and their progress\n"
+                      "library / lib [n]         - Browse library & playlists (from track n)\n"
+                      "search [promt]           - Fuzzy search, best matches first (no prompt: search as you type, also '/')\n"
                       "play <name>               - Play a track from library\n"
                       "pause                     - Toggle pause/resume\n"
                       "stop                      - Stop playback\n"
+                      "seek <mm:ss>              - Jump to a position in the current track\n"
+                      "ff / rew [seconds]        - Skip forward / back (default 10s)\n"
                       "volume                    - Show current volume\n"
                       "setvolume <0-100>         - Set the volume\n"
+                      "audio                     - Show audio device settings\n"
+                      "setaudio <key> <value>    - rate <hz>, buffer <frames>, format <s16|f32>, native <on|off>\n"
                       "setmode <mode>            - Set playback mode (no-repeat, repeat-one, repeat-all, shuffle)\n"
                       "listnew <name>            - Create a new playlist\n"
                       "createlist <name>         - Alias to listnew\n"
@@ -193,48 +215,170 @@ void cmd_help(AppState *state, const char *argument) {
                       "listaddmulti <pl> <id>..  - Add multiple tracks to playlist by ID from library.\n"
                       "listview <name>           - View tracks in a playlist\n"
                       "listplay <name>           - Play a playlist\n"
-                      "next                      - Skips current track in playlist"
+                      "next                      - Skips current track in playlist\n"
+                      "uistats                   - Show terminal output per second\n"
                       "author                    - Show authors\n"
                       "quit                      - Exit the player";
     snprintf(state->message, sizeof(state->message), "%s", msg);
 }
 
-void cmd_library(AppState *state, const char *argument) {
-        int rows, cols, line = 2, mid;
+/*
+ * A list of any length shown a screenful at a time.  Nothing is copied:
+ * row() formats entry i straight from the library arrays, and only for
+ * the rows on screen, so scrolling or jumping costs the same however
+ * long the list is.
+ */
+struct list_view {
+    const char *title;
+    int count;
+    int top;     /* first entry on screen */
+    int mark;    /* entry jumped to, highlighted; -1 if none */
+    void (*row)(const AppState *state, const void *ctx, int i, char *buf,
+                size_t size);
+    const void *ctx;
+    /* Optional right-hand column; the list then takes the left half. */
+    void (*side)(const AppState *state, int rows, int x, int width);
+};
+
+static void list_view_draw(const AppState *state, const struct list_view *v,
+                           int rows, int cols, int page, int jump) {
+    int width = v->side ? cols / 2 - 4 : cols - 4;
+    char buf[512];
+    int i;
 
-    getmaxyx(stdscr, rows, cols);
-    clear();
-    mid = cols / 2;
+    erase();
+    mvprintw(0, 2, "--- %s ---", v->title);
+    if (v->count == 0)
+      mvprintw(2, 4, "Empty.");
+
+    for (i = v->top; i < v->count && i < v->top + page; i++) {
+      v->row(state, v->ctx, i, buf, sizeof(buf));
+      if (i == v->mark)
+        attron(A_REVERSE);
+      if (width > 0)
+        mvaddnstr(2 + i - v->top, 4, buf, width);
+      if (i == v->mark)
+        attroff(A_REVERSE);
+    }
+    if (v->side)
+      v->side(state, rows, cols / 2 + 2, cols - cols / 2 - 4);
 
-    mvprintw(0, 2, "--- Library ---");
-    mvprintw(0, mid + 2, "--- Playlists ---");
+    attron(A_REVERSE);
+    if (jump > 0)
+      mvprintw(rows - 1, 0, "Go to: %d (Enter to jump)", jump);
+    else
+      mvprintw(rows - 1, 0,
+               "%d-%d of %d  Up/Down/PgUp/PgDn/Home/End scroll, "
+               "<number> Enter jumps, any other key returns",
+               v->count ? v->top + 1 : 0,
+               v->top + page < v->count ? v->top + page : v->count,
+               v->count);
+    attroff(A_REVERSE);
+    refresh();
+}
 
-    for (int i = 0; i < rows - 4; i++) {
-      if (i < state->track_count) {
-        char left[256];
+/* Scroll and jump around in v until a key that means "done". */
+static void list_view_run(AppState *state, struct list_view *v) {
+    int rows, cols, page, ch, jump = 0;
 
-        snprintf(left, sizeof(left), "%d: %s", i + 1, state->library[i].name);
-        left[mid - 4] = '\0';
-        mvprintw(i + 2, 2, "%s", left);
+    timeout(-1);
+    for (;;) {
+      getmaxyx(stdscr, rows, cols);
+      page = rows - 4 > 1 ? rows - 4 : 1;
+      if (v->top > v->count - page)
+        v->top = v->count - page;
+      if (v->top < 0)
+        v->top = 0;
+      list_view_draw(state, v, rows, cols, page, jump);
+
+      ch = getch();
+      if (ch >= '0' && ch <= '9') {
+        if (jump <= (INT_MAX - 9) / 10)
+          jump = jump * 10 + (ch - '0');
+        continue;
+      }
+      if (jump > 0 && ch != KEY_RESIZE) {
+        if (ch == '\n' || ch == '\r' || ch == KEY_ENTER) {
+          v->mark = jump <= v->count ? jump - 1 : v->count - 1;
+          v->top = v->mark;
+        } else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+          jump /= 10;
+          continue;
+        }
+        jump = 0;
+        continue;
       }
-      if (i < state->playlist_count) {
-        char right[256];
 
-        snprintf(right, sizeof(right), "%d: %s", i + 1,
-                 state->playlists[i].name);
-        right[cols - mid - 4] = '\0';
-        mvprintw(i + 2, mid + 2, "%s", right);
+      switch (ch) {
+      case KEY_RESIZE:
+        break;
+      case KEY_UP:
+        v->top--;
+        break;
+      case KEY_DOWN:
+        v->top++;
+        break;
+      case KEY_PPAGE:
+        v->top -= page;
+        break;
+      case KEY_NPAGE:
+      case ' ':
+        v->top += page;
+        break;
+      case KEY_HOME:
+        v->top = 0;
+        break;
+      case KEY_END:
+        v->top = v->count;
+        break;
+      default:
+        timeout(0);
+        return;
       }
     }
+}
 
-    attron(A_REVERSE);
-    mvprintw(rows - 1, 0, "Press any key to return");
-    attroff(A_REVERSE);
-    refresh();
+static void library_row(const AppState *state, const void *ctx, int i,
+                        char *buf, size_t size) {
+    (void)ctx;
+    snprintf(buf, size, "%d: %s", i + 1, library_name(state, i));
+}
 
-    timeout(-1);
-    getch();
-    timeout(100);
+static void playlists_column(const AppState *state, int rows, int x,
+                             int width) {
+    char buf[256];
+    int i;
+
+    mvprintw(0, x, "--- Playlists ---");
+    for (i = 0; i < state->playlist_count; i++) {
+      if (2 + i >= rows - 2) {
+        mvprintw(2 + i, x, "...");
+        break;
+      }
+      snprintf(buf, sizeof(buf), "%d: %s", i + 1, state->playlists[i].name);
+      if (width > 0)
+        mvaddnstr(2 + i, x, buf, width);
+    }
+}
+
+void cmd_library(AppState *state, const char *argument) {
+    struct list_view v = {
+      .title = "Library",
+      .count = state->track_count,
+      .mark = -1,
+      .row = library_row,
+      .side = playlists_column,
+    };
+
+    /* "library 5000" opens the view at track 5000. */
+    if (argument && *argument) {
+      int n = atoi(argument);
+
+      if (n >= 1 && n <= state->track_count)
+        v.top = v.mark = n - 1;
+    }
+
+    list_view_run(state, &v);
 
     snprintf(state->message, sizeof(state->message),
              "Returned from library view.");
@@ -263,20 +407,17 @@ void cmd_rename(AppState *state, char *argument) {
     }
     int track_index = (int)idx_long - 1;
 
-    if (strlen(new_name_arg) >= sizeof(state->library[track_index].name)) {
-      snprintf(state->message, sizeof(state->message), "Error: New name '%s' is too long (max %zu chars).", new_name_arg, sizeof(state->library[track_index].name) - 1);
+    char *old_name = strdup(library_name(state, track_index));
+
+    if (!old_name || library_rename_track(state, track_index, new_name_arg) != 0) {
+      snprintf(state->message, sizeof(state->message), "Error: cannot rename track (out of memory).");
+      free(old_name);
       return;
     }
 
-    char old_name[sizeof(state->library[track_index].name)];
-    strncpy(old_name, state->library[track_index].name, sizeof(old_name) - 1);
-    old_name[sizeof(old_name) - 1] = '\0';
-
-    strncpy(state->library[track_index].name, new_name_arg, sizeof(state->library[track_index].name) - 1);
-    state->library[track_index].name[sizeof(state->library[track_index].name) - 1] = '\0';
-
     snprintf(state->message, sizeof(state->message), "Renamed track '%s' to '%s'.", old_name, new_name_arg);
-    config_save(state); 
+    free(old_name);
+    journal_log_rename(state, track_index);
 }
 
 void cmd_play(AppState *state, char *argument) {
@@ -284,19 +425,15 @@ void cmd_play(AppState *state, char *argument) {
       snprintf(state->message, sizeof(state->message),
                "Usage: play <track_name>");
     } else {
-      int i, found = 0;
+      int i;
 
       state->playing_playlist_index = -1;
       state->playing_track_index_in_playlist = 0;
 
-      for (i = 0; i < state->track_count; i++) {
-        if (strcmp(state->library[i].name, argument) == 0) {
-          play_track(state, state->library[i].path);
-          found = 1;
-          break;
-        }
-      }
-      if (!found) {
+      i = library_find_by_name(state, argument);
+      if (i >= 0) {
+        play_library_track(state, i);
+      } else {
         snprintf(state->message, sizeof(state->message),
                  "Error: Track '%s' not found in library.", argument);
       }
@@ -325,7 +462,7 @@ void cmd_volume(AppState *state, char *argument) {
     refresh();
     timeout(-1);
     getch();
-    timeout(100);
+    timeout(0);
 
     snprintf(state->message, sizeof(state->message),
              "Returned from volume view.");
@@ -346,11 +483,173 @@ void cmd_setvolume(AppState *state, const char *argument) {
         state->current_volume = v;
         player_set_volume(v);
         snprintf(state->message, sizeof(state->message), "Volume set to %d", v);
-        config_save(state);
+        journal_log_volume(state);
       }
     }
 }
 
+#define SEEK_STEP_SECONDS 10
+
+/* "[[h:]m:]s" to seconds; 0 on success. */
+static int parse_time(const char *s, double *out) {
+    long total = 0, field;
+    int fields = 0;
+    char *end;
+
+    for (;;) {
+      if (!isdigit((unsigned char)*s))
+        return -1;
+      field = strtol(s, &end, 10);
+      if (fields > 0 && field >= 60)
+        return -1;
+      total = total * 60 + field;
+      if (++fields > 3)
+        return -1;
+      if (*end == '\0')
+        break;
+      if (*end != ':')
+        return -1;
+      s = end + 1;
+    }
+    *out = (double)total;
+    return 0;
+}
+
+static void seek_to(AppState *state, double target) {
+    if (state->track_duration > 0 && target > state->track_duration)
+      target = state->track_duration;
+    if (target < 0)
+      target = 0;
+
+    if (!player_is_playing() || player_seek(target) != 0) {
+      snprintf(state->message, sizeof(state->message), "Cannot seek now.");
+      return;
+    }
+    snprintf(state->message, sizeof(state->message), "Position: %02d:%02d.",
+             (int)target / 60, (int)target % 60);
+}
+
+void cmd_seek(AppState *state, const char *argument) {
+    double target;
+
+    if (!argument || *argument == '\0' || parse_time(argument, &target) != 0) {
+      snprintf(state->message, sizeof(state->message),
+               "Usage: seek <mm:ss>");
+      return;
+    }
+    seek_to(state, target);
+}
+
+/* ff / rew [seconds] */
+void cmd_skip_time(AppState *state, const char *argument, int direction) {
+    double step = SEEK_STEP_SECONDS;
+
+    if (argument && *argument != '\0' && parse_time(argument, &step) != 0) {
+      snprintf(state->message, sizeof(state->message),
+               "Usage: %s [seconds]", direction > 0 ? "ff" : "rew");
+      return;
+    }
+    seek_to(state, player_get_current_position() + direction * step);
+}
+
+void cmd_audio(AppState *state) {
+    const AudioConfig *a = &state->audio;
+
+    snprintf(state->message, sizeof(state->message),
+             "Audio: %d Hz (device %d Hz), %s, buffer %d frames (%.1f ms), "
+             "native rate %s",
+             a->rate, player_device_rate(), audio_format_name(a->format),
+             a->buffer, a->buffer * 1000.0 / a->rate,
+             a->native_rate ? "on" : "off");
+}
+
+/* setaudio rate <hz> | buffer <frames> | format <s16|f32> | native <on|off> */
+void cmd_setaudio(AppState *state, const char *argument) {
+    AudioConfig a = state->audio;
+    char key[16], value[16], track[PATH_MAX];
+    double pos = 0.0;
+    int was_playing;
+
+    if (!argument || sscanf(argument, "%15s %15s", key, value) != 2) {
+      snprintf(state->message, sizeof(state->message),
+               "Usage: setaudio rate <hz> | buffer <frames> | "
+               "format <s16|f32> | native <on|off>");
+      return;
+    }
+
+    if (strcmp(key, "rate") == 0) {
+      a.rate = atoi(value);
+    } else if (strcmp(key, "buffer") == 0) {
+      a.buffer = atoi(value);
+    } else if (strcmp(key, "format") == 0) {
+      a.format = audio_format_from_name(value);
+    } else if (strcmp(key, "native") == 0) {
+      a.native_rate = strcmp(value, "on") == 0 || strcmp(value, "1") == 0;
+    } else {
+      snprintf(state->message, sizeof(state->message),
+               "Unknown audio setting: %s", key);
+      return;
+    }
+
+    if (!config_audio_valid(&a)) {
+      snprintf(state->message, sizeof(state->message),
+               "Invalid value. Rate %d-%d Hz, buffer a power of two "
+               "%d-%d frames, format s16 or f32.",
+               AUDIO_RATE_MIN, AUDIO_RATE_MAX, AUDIO_BUFFER_MIN,
+               AUDIO_BUFFER_MAX);
+      return;
+    }
+
+    /* Reopening the device stops playback; pick it up where it was. */
+    was_playing = player_is_playing() && state->current_track[0] != '\0';
+    if (was_playing) {
+      pos = player_get_current_position();
+      strncpy(track, state->current_track, sizeof(track) - 1);
+      track[sizeof(track) - 1] = '\0';
+    }
+
+    if (player_set_audio(&a) != 0) {
+      snprintf(state->message, sizeof(state->message),
+               "The audio device rejected these settings.");
+      return;
+    }
+    state->audio = a;
+    config_mark_dirty(state);
+
+    if (was_playing) {
+      play_track(state, track);
+      player_seek(pos);
+    }
+    cmd_audio(state);
+}
+
+/* Terminal output since the last call, to check what redraws cost. */
+void cmd_uistats(AppState *state) {
+    static unsigned long long last_bytes;
+    static struct timespec last;
+    unsigned long long bytes = ui_bytes_written();
+    struct timespec now;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    secs = last.tv_sec ? (now.tv_sec - last.tv_sec) +
+                             (now.tv_nsec - last.tv_nsec) / 1e9
+                       : 0.0;
+
+    if (secs > 0.0)
+      snprintf(state->message, sizeof(state->message),
+               "Terminal output: %.0f bytes/s over the last %.1f s "
+               "(%llu bytes total)",
+               (bytes - last_bytes) / secs, secs, bytes);
+    else
+      snprintf(state->message, sizeof(state->message),
+               "Terminal output: %llu bytes total; run uistats again "
+               "to get a rate", bytes);
+
+    last_bytes = bytes;
+    last = now;
+}
+
 void cmd_show_authors(AppState *state) {
         snprintf(state->message, sizeof(state->message),
              "---Authors---\n dormant1337: https://github.com/Zer0Flux86\n "
@@ -362,46 +661,17 @@ void cmd_remove(AppState *state, const char *argument) {
       snprintf(state->message, sizeof(state->message),
                "Usage: remove <track_name>");
     } else {
-      int i, idx = -1;
+      int idx = library_find_by_name(state, argument);
 
-      for (i = 0; i < state->track_count; i++) {
-        if (strcmp(state->library[i].name, argument) == 0) {
-          idx = i;
-          break;
-        }
-      }
       if (idx == -1) {
         snprintf(state->message, sizeof(state->message), "Track not found...");
       } else {
-        for (int p = 0; p < state->playlist_count; p++) {
-          Playlist *pl = &state->playlists[p];
-          int w = 0;
-
-          if (!pl->track_indices || pl->track_count <= 0) {
-            pl->track_count = 0;
-            continue;
-          }
-
-          for (int r = 0; r < pl->track_count; r++) {
-            int t = pl->track_indices[r];
-
-            if (t == idx)
-              continue;
-            if (t > idx)
-              t--;
-            pl->track_indices[w++] = t;
-          }
-          pl->track_count = w;
-        }
-
-        for (i = idx; i < state->track_count - 1; i++)
-          state->library[i] = state->library[i + 1];
-        state->track_count--;
+        library_remove_track(state, idx);
 
         snprintf(state->message, sizeof(state->message), "Removed track: '%s'",
                  argument);
 
-        config_save(state);
+        journal_log_remove(state, idx);
       }
     }
 }
@@ -473,24 +743,20 @@ void cmd_listaddmulti(AppState *state, char *argument) {
         continue;
       }
 
-      if (ensure_playlist_tracks_capacity(pl, 1) != 0) {
+      if (playlist_append_track(state, pidx, track_id - 1) != 0) {
         snprintf(state->message, sizeof(state->message),
                  "Playlist '%s': cannot grow (out of memory). Added %d so far.",
                  pl->name, added_count);
-        if (added_count > 0)
-          config_save(state);
         return;
       }
 
-      pl->track_indices[pl->track_count] = track_id - 1;
-      pl->track_count++;
+      journal_log_playlist_add(state, pidx, track_id - 1);
       added_count++;
     }
 
     if (added_count > 0) {
       snprintf(state->message, sizeof(state->message),
                "Added %d tracks to playlist '%s'.", added_count, pl->name);
-      config_save(state);
     } else {
       snprintf(state->message, sizeof(state->message),
                "No valid tracks added. Check track IDs.");
@@ -565,10 +831,8 @@ void cmd_listremove(AppState *state, const char *argument) {
       return;
     }
 
-    for (int i = track_idx_to_remove - 1; i < pl->track_count - 1; i++) {
-      pl->track_indices[i] = pl->track_indices[i + 1];
-    }
-    pl->track_count--;
+    playlist_remove_at(state, pidx, track_idx_to_remove - 1);
+    journal_log_playlist_remove(state, pidx, track_idx_to_remove - 1);
 
     if (state->playing_playlist_index == pidx &&
         state->playing_track_index_in_playlist >= track_idx_to_remove - 1) {
@@ -585,7 +849,6 @@ void cmd_listremove(AppState *state, const char *argument) {
     snprintf(state->message, sizeof(state->message),
              "Removed track at index %d from playlist '%s'.",
              track_idx_to_remove, pl->name);
-    config_save(state);
 }
 
 void cmd_deletelist(AppState *state, const char *argument) {
@@ -609,28 +872,17 @@ void cmd_deletelist(AppState *state, const char *argument) {
       return;
     }
 
-    free(state->playlists[pidx].track_indices);
-    state->playlists[pidx].track_indices = NULL;
-    state->playlists[pidx].track_capacity = 0;
-    state->playlists[pidx].track_count = 0;
-
-    for (int i = pidx; i < state->playlist_count - 1; i++) {
-      state->playlists[i] = state->playlists[i + 1];
-    }
-    state->playlist_count--;
-
     if (state->playing_playlist_index == pidx) {
         player_stop();
-        state->playing_playlist_index = -1;
         state->current_track[0] = '\0';
         state->track_duration = 0.0;
-    } else if (state->playing_playlist_index > pidx) {
-        state->playing_playlist_index--;
     }
 
+    playlist_delete(state, pidx);
+    journal_log_playlist_delete(state, pidx);
+
     snprintf(state->message, sizeof(state->message),
              "Playlist '%s' deleted.", argument);
-    config_save(state);
 }
 
 void cmd_listnew(AppState *state, const char *argument, const char *command) {
@@ -639,45 +891,30 @@ void cmd_listnew(AppState *state, const char *argument, const char *command) {
                "Usage: %s <playlist_name>",
                strcmp(command, "listnew") == 0 ? "listnew" : "createlist");
     } else {
-      if (ensure_playlists_capacity(state, 1) != 0) {
+      int exists = 0;
+
+      for (int i = 0; i < state->playlist_count; i++) {
+        if (strcmp(state->playlists[i].name, argument) == 0) {
+          exists = 1;
+          break;
+        }
+      }
+      if (exists) {
         snprintf(state->message, sizeof(state->message),
-                 "Error: cannot grow playlists (out of memory).");
+                 "Error: Playlist '%s' already exists.", argument);
       } else {
-        int exists = 0;
+        int pidx = playlist_create(state, argument);
 
-        for (int i = 0; i < state->playlist_count; i++) {
-          if (strcmp(state->playlists[i].name, argument) == 0) {
-            exists = 1;
-            break;
-          }
-        }
-        if (exists) {
+        if (pidx < 0) {
           snprintf(state->message, sizeof(state->message),
-                   "Error: Playlist '%s' already exists.", argument);
-        } else {
-          Playlist *pl = &state->playlists[state->playlist_count];
-
-          if (!pl->track_indices) {
-            pl->track_indices = (int *)malloc(100 * sizeof(int));
-            if (!pl->track_indices) {
-              snprintf(state->message, sizeof(state->message),
-                       "Out of memory (new playlist indices).");
-              return;
-            }
-            pl->track_capacity = 100;
-          }
-          pl->track_count = 0;
-
-          strncpy(pl->name, argument, sizeof(pl->name) - 1);
-          pl->name[sizeof(pl->name) - 1] = '\0';
-
-          state->playlist_count++;
+                   "Error: cannot grow playlists (out of memory).");
+          return;
+        }
 
-          snprintf(state->message, sizeof(state->message),
-                   "Created playlist '%s'.", argument);
+        snprintf(state->message, sizeof(state->message),
+                 "Created playlist '%s'.", argument);
 
-          config_save(state);
-        }
+        journal_log_playlist_new(state, pidx);
       }
     }
 }
@@ -766,35 +1003,36 @@ void cmd_listadd(AppState *state, const char *argument) {
       return;
     }
 
-    for (int i = 0; i < state->track_count; i++) {
-      if (strcmp(state->library[i].name, tr_name) == 0) {
-        tidx = i;
-        break;
-      }
-    }
+    tidx = library_find_by_name(state, tr_name);
     if (tidx == -1) {
       snprintf(state->message, sizeof(state->message),
                "Error: Track '%s' not found in library.", tr_name);
       return;
     }
 
-    if (ensure_playlist_tracks_capacity(&state->playlists[pidx], 1) != 0) {
+    if (playlist_append_track(state, pidx, tidx) != 0) {
       snprintf(state->message, sizeof(state->message),
                "Error: Playlist '%s' cannot grow (out of memory).",
                state->playlists[pidx].name);
     } else {
-      Playlist *pl = &state->playlists[pidx];
-
-      pl->track_indices[pl->track_count] = tidx;
-      pl->track_count++;
-
       snprintf(state->message, sizeof(state->message),
                "Added '%s' to playlist '%s'.", tr_name, pl_name);
 
-      config_save(state);
+      journal_log_playlist_add(state, pidx, tidx);
     }
 }
 
+static void playlist_row(const AppState *state, const void *ctx, int i,
+                         char *buf, size_t size) {
+    const Playlist *pl = ctx;
+    int t = pl->track_indices[i];
+
+    if (t >= 0 && t < state->track_count)
+      snprintf(buf, size, "%d: %s", i + 1, library_name(state, t));
+    else
+      snprintf(buf, size, "%d: (missing track)", i + 1);
+}
+
 void cmd_listview(AppState *state, const char *argument) {
         if (!argument || *argument == '\0') {
       snprintf(state->message, sizeof(state->message),
@@ -816,41 +1054,21 @@ void cmd_listview(AppState *state, const char *argument) {
       return;
     }
 
-    {
-      Playlist *pl = &state->playlists[pidx];
-      int rows, cols, line = 2;
-
-      getmaxyx(stdscr, rows, cols);
-      clear();
-      mvprintw(0, 2, "--- Playlist: %s ---", pl->name);
-
-      if (!pl->track_indices || pl->track_count == 0) {
-        mvprintw(line++, 4, "Empty.");
-      } else {
-        for (int i = 0; i < pl->track_count; i++) {
-          if (line >= rows - 2) {
-            mvprintw(line, 4, "...");
-            break;
-          }
-          int t = pl->track_indices[i];
-
-          if (t >= 0 && t < state->track_count)
-            mvprintw(line++, 4, "%d: %s", i + 1, state->library[t].name);
-        }
-      }
-
-      attron(A_REVERSE);
-      mvprintw(rows - 1, 0, "Press any key to return");
-      attroff(A_REVERSE);
-
-      refresh();
-      timeout(-1);
-      getch();
-      timeout(100);
+    Playlist *pl = &state->playlists[pidx];
+    char title[sizeof(pl->name) + 16];
+    struct list_view v = {
+      .title = title,
+      .count = pl->track_indices ? pl->track_count : 0,
+      .mark = -1,
+      .row = playlist_row,
+      .ctx = pl,
+    };
+
+    snprintf(title, sizeof(title), "Playlist: %s", pl->name);
+    list_view_run(state, &v);
 
-      snprintf(state->message, sizeof(state->message),
-               "Returned from playlist view.");
-    }
+    snprintf(state->message, sizeof(state->message),
+             "Returned from playlist view.");
 }
 
 void cmd_listplay(AppState *state, const char *argument) {
@@ -888,7 +1106,7 @@ void cmd_listplay(AppState *state, const char *argument) {
       int lib_idx = state->playlists[pidx].track_indices[0];
 
       if (lib_idx >= 0 && lib_idx < state->track_count) {
-        play_track(state, state->library[lib_idx].path);
+        play_library_track(state, lib_idx);
         snprintf(state->message, sizeof(state->message),
                  "Playing playlist '%s'", state->playlists[pidx].name);
       } else {
@@ -910,44 +1128,40 @@ void cmd_stop(AppState *state) {
 
 void cmd_search(AppState *state, const char *argument) {
   if (!argument || *argument == '\0') {
-        snprintf(state->message, sizeof(state->message), "Usage: search <query>");
+        search_filter_open(state);
         return;
     }
 
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
     clear();
-    mvprintw(0, 2, "--- Search Results for '%s' ---", argument);
 
+    /* Rank everything, but only keep as many as there are lines for. */
     int line = 2;
-    int found_count = 0;
-    char query_lower[256];
-    char track_name_lower[256];
+    int k = rows - 4 > 0 ? rows - 4 : 1;
+    int total;
+    struct fuzzy_hit *hits = malloc((size_t)k * sizeof(*hits));
+    int found_count = hits ? library_fuzzy_search(state, argument, hits, k, &total) : -1;
     int i;
 
-    for (i = 0; argument[i] && i < sizeof(query_lower) - 1; i++) {
-        query_lower[i] = tolower((unsigned char)argument[i]);
+    if (found_count > 0) {
+        mvprintw(0, 2, "--- Search Results for '%s' (%d found, best first) ---", argument, total);
+    } else {
+        mvprintw(0, 2, "--- Search Results for '%s' ---", argument);
     }
-    query_lower[i] = '\0';
 
-    for (i = 0; i < state->track_count; i++) {
-        int j;
-        for (j = 0; state->library[i].name[j] && j < sizeof(track_name_lower) - 1; j++) {
-            track_name_lower[j] = tolower((unsigned char)state->library[i].name[j]);
-        }
-        track_name_lower[j] = '\0';
-
-        if (strstr(track_name_lower, query_lower)) {
-            found_count++;
-            if (line >= rows - 2) {
-                mvprintw(line, 4, "...");
-                break; 
-            }
-            mvprintw(line++, 4, "%d: %s", i + 1, state->library[i].name);
-        }
+    for (i = 0; i < found_count; i++) {
+        mvprintw(line++, 4, "%d: %s", hits[i].slot + 1,
+                 library_name(state, hits[i].slot));
+    }
+    if (found_count > 0 && total > found_count) {
+        mvprintw(line, 4, "... and %d more", total - found_count);
     }
+    free(hits);
 
-    if (found_count == 0) {
+    if (found_count < 0) {
+        mvprintw(line, 4, "Search failed (out of memory).");
+    } else if (found_count == 0) {
         mvprintw(line, 4, "No tracks found matching '%s'.", argument);
     }
 
@@ -958,12 +1172,11 @@ void cmd_search(AppState *state, const char *argument) {
 
     timeout(-1); 
     getch();
-    timeout(100); 
+    timeout(0); 
 
     snprintf(state->message, sizeof(state->message), "Returned from search.");
 }
 
-
 void cmd_next(AppState *state) {
     if (state->playing_playlist_index != -1) {
         Playlist *pl = &state->playlists[state->playing_playlist_index];
@@ -987,7 +1200,7 @@ void cmd_next(AppState *state) {
         if (state->playing_track_index_in_playlist < pl->track_count) {
             int lib_idx = pl->track_indices[state->playing_track_index_in_playlist];
             if (lib_idx >= 0 && lib_idx < state->track_count) {
-                play_track(state, state->library[lib_idx].path);
+                play_library_track(state, lib_idx);
                 snprintf(state->message, sizeof(state->message), "Skipped to next track in '%s'.", pl->name);
             } else {
                 player_stop();
@@ -1014,7 +1227,7 @@ void cmd_next(AppState *state) {
                 next_track_index = (rand() % state->track_count); 
                 snprintf(state->message, sizeof(state->message), "Skipped to next track.");
             }
-            play_track(state, state->library[next_track_index].path);
+            play_library_track(state, next_track_index);
         } else {
             player_stop();
             state->current_track[0] = '\0';
@@ -1071,7 +1284,7 @@ void cmd_skip(AppState *state)
 		lib_idx = pl->track_indices[state->playing_track_index_in_playlist];
 
 		if (lib_idx >= 0 && lib_idx < state->track_count) {
-			play_track(state, state->library[lib_idx].path);
+			play_library_track(state, lib_idx);
 			if (strcmp(state->mode, "shuffle") == 0)
 				snprintf(state->message, sizeof(state->message),
 					 "Shuffling to next track in '%s'.", pl->name);
@@ -1090,7 +1303,7 @@ void cmd_skip(AppState *state)
 		if (strcmp(state->mode, "shuffle") == 0 || strcmp(state->mode, "repeat-all") == 0) {
 			if (state->track_count > 0) {
 				int next_track_index = rand() % state->track_count;
-				play_track(state, state->library[next_track_index].path);
+				play_library_track(state, next_track_index);
 				snprintf(state->message, sizeof(state->message),
 					 "Skipping to random track from library.");
 			} else {
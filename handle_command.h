@@ -8,7 +8,9 @@
 
 void cmd_add(AppState *state, const char *argument);
 void cmd_addfolder(AppState *state, const char *argument);
+void cmd_cancel(AppState *state);
 void cmd_webdownload(AppState *state, const char *argument);
+void cmd_jobs(AppState *state);
 void cmd_help(AppState *state, const char *argument);
 void cmd_library(AppState *state, const char *argument);
 void cmd_rename(AppState *state, const char *argument); 
@@ -16,6 +18,11 @@ void cmd_play(AppState *state, const char *argument);
 void cmd_pause(AppState *state);
 void cmd_volume(AppState *state, const char *argument); 
 void cmd_setvolume(AppState *state, const char *argument);
+void cmd_seek(AppState *state, const char *argument);
+void cmd_skip_time(AppState *state, const char *argument, int direction);
+void cmd_audio(AppState *state);
+void cmd_uistats(AppState *state);
+void cmd_setaudio(AppState *state, const char *argument);
 void cmd_show_authors(AppState *state);
 void cmd_remove(AppState *state, const char *argument);
 void cmd_setmode(AppState *state, const char *argument);
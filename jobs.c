@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "jobs.h"
+
+extern char **environ;
+
+struct job {
+	struct job_info	 info;
+	pid_t		 pid;		/* 0 once reaped */
+	int		 fd;		/* output pipe, -1 at EOF */
+	char		*outdir;
+	char		 partial[JOB_LINE_MAX];	/* unterminated output line */
+	size_t		 partial_len;
+	int		 scan;		/* look for new files on next poll */
+};
+
+/*
+ * Snapshot of the download directory: the inodes of the .mp3 files
+ * already in it, and the directory's mtime when it was last read.  A scan
+ * is skipped outright while that mtime is unchanged, and otherwise only
+ * entries with an unknown inode (from readdir, no stat needed) are looked
+ * at, so importing after a download costs O(new files).
+ */
+struct dir_snap {
+	char		*dir;
+	struct timespec	 mtime;
+	int		 synced;	/* mtime is valid */
+	ino_t		*inos;		/* open addressing, 0 is empty */
+	size_t		 cap;		/* power of two */
+	size_t		 used;
+};
+
+static struct job *g_jobs[JOBS_MAX];
+static int g_next_id = 1;
+static struct dir_snap g_snap;
+
+static void job_free(struct job *j)
+{
+	if (j->fd >= 0)
+		close(j->fd);
+	free(j->outdir);
+	free(j);
+}
+
+static size_t ino_hash(ino_t ino, size_t mask)
+{
+	uint64_t h = (uint64_t)ino * 0x9e3779b97f4a7c15ULL;
+
+	return (size_t)(h >> 32) & mask;
+}
+
+/* Return: 1 if ino was new, 0 if known, -1 on allocation failure. */
+static int snap_add(struct dir_snap *s, ino_t ino)
+{
+	size_t i, mask, cap;
+	ino_t *old;
+
+	if ((s->used + 1) * 2 > s->cap) {
+		cap = s->cap ? s->cap * 2 : 256;
+		old = s->inos;
+		s->inos = calloc(cap, sizeof(*s->inos));
+		if (!s->inos) {
+			s->inos = old;
+			return -1;
+		}
+		for (i = 0; i < s->cap; i++) {
+			size_t k;
+
+			if (!old[i])
+				continue;
+			for (k = ino_hash(old[i], cap - 1); s->inos[k];
+			     k = (k + 1) & (cap - 1))
+				;
+			s->inos[k] = old[i];
+		}
+		free(old);
+		s->cap = cap;
+	}
+
+	mask = s->cap - 1;
+	for (i = ino_hash(ino, mask); s->inos[i]; i = (i + 1) & mask)
+		if (s->inos[i] == ino)
+			return 0;
+	s->inos[i] = ino;
+	s->used++;
+	return 1;
+}
+
+static void snap_reset(struct dir_snap *s)
+{
+	free(s->dir);
+	free(s->inos);
+	memset(s, 0, sizeof(*s));
+}
+
+static int is_mp3(const char *name)
+{
+	const char *dot = strrchr(name, '.');
+
+	return dot && strcasecmp(dot, ".mp3") == 0;
+}
+
+/*
+ * Bring the snapshot of dir up to date, passing each .mp3 that was not in
+ * it to cb (if any) on behalf of job.
+ */
+static void snap_sync(const char *dir, struct job *j, job_cb cb, void *arg)
+{
+	char path[4096];
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+
+	if (!g_snap.dir || strcmp(g_snap.dir, dir) != 0) {
+		snap_reset(&g_snap);
+		g_snap.dir = strdup(dir);
+		if (!g_snap.dir)
+			return;
+	}
+
+	if (stat(dir, &st) != 0)
+		return;
+	if (g_snap.synced && st.st_mtim.tv_sec == g_snap.mtime.tv_sec &&
+	    st.st_mtim.tv_nsec == g_snap.mtime.tv_nsec)
+		return;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+	g_snap.mtime = st.st_mtim;
+	g_snap.synced = 1;
+
+	while ((de = readdir(d)) != NULL) {
+		if (!is_mp3(de->d_name) || snap_add(&g_snap, de->d_ino) != 1)
+			continue;
+		if (!cb)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		j->info.files++;
+		cb(&j->info, path, arg);
+	}
+	closedir(d);
+}
+
+/* A free slot, evicting the oldest finished job if need be. */
+static int job_slot(void)
+{
+	int i, oldest = -1;
+
+	for (i = 0; i < JOBS_MAX; i++) {
+		if (!g_jobs[i])
+			return i;
+		if (g_jobs[i]->info.state != JOB_RUNNING &&
+		    (oldest < 0 || g_jobs[i]->info.id < g_jobs[oldest]->info.id))
+			oldest = i;
+	}
+	if (oldest >= 0) {
+		job_free(g_jobs[oldest]);
+		g_jobs[oldest] = NULL;
+	}
+	return oldest;
+}
+
+/**
+ * jobs_start_download() - run "spotdl download <query> --output <outdir>".
+ *
+ * Return: the job id, or -1 if the process could not be started (all
+ * slots busy, no pipe, spotdl not found).
+ */
+int jobs_start_download(const char *query, const char *outdir)
+{
+	const char *prog = getenv("LMP_SPOTDL");
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t attr;
+	char *argv[6];
+	struct job *j;
+	int pipefd[2], slot, err;
+
+	if (!prog || !*prog)
+		prog = "spotdl";
+
+	slot = job_slot();
+	if (slot < 0)
+		return -1;
+
+	j = calloc(1, sizeof(*j));
+	if (!j)
+		return -1;
+	j->fd = -1;
+	j->outdir = strdup(outdir);
+	if (!j->outdir || pipe(pipefd) != 0) {
+		job_free(j);
+		return -1;
+	}
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+
+	argv[0] = (char *)prog;
+	argv[1] = "download";
+	argv[2] = (char *)query;
+	argv[3] = "--output";
+	argv[4] = j->outdir;
+	argv[5] = NULL;
+
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null",
+					 O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&fa, pipefd[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&fa, pipefd[1], STDERR_FILENO);
+	posix_spawn_file_actions_addclose(&fa, pipefd[1]);
+
+	/* Own group: ^C on the player's terminal does not reach it. */
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	/*
+	 * What is there now is not this job's; catch up without reporting
+	 * (a running job would have reported it already).
+	 */
+	if (!jobs_running())
+		snap_sync(outdir, NULL, NULL, NULL);
+
+	err = posix_spawnp(&j->pid, prog, &fa, &attr, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	posix_spawnattr_destroy(&attr);
+	close(pipefd[1]);
+	if (err != 0) {
+		close(pipefd[0]);
+		job_free(j);
+		return -1;
+	}
+
+	j->fd = pipefd[0];
+	j->info.id = g_next_id++;
+	j->info.state = JOB_RUNNING;
+	j->info.percent = -1;
+	j->info.started = time(NULL);
+	snprintf(j->info.query, sizeof(j->info.query), "%s", query);
+	g_jobs[slot] = j;
+	return j->info.id;
+}
+
+static void job_line(struct job *j, char *line)
+{
+	char *p, *end;
+	long pct;
+
+	while (isspace((unsigned char)*line))
+		line++;
+	end = line + strlen(line);
+	while (end > line && isspace((unsigned char)end[-1]))
+		*--end = '\0';
+	if (!*line)
+		return;
+
+	snprintf(j->info.last_line, sizeof(j->info.last_line), "%s", line);
+
+	/* The last "NN%" on the line is the progress. */
+	for (p = line; (p = strchr(p, '%')) != NULL; p++) {
+		char *q = p;
+
+		while (q > line && isdigit((unsigned char)q[-1]))
+			q--;
+		if (q == p)
+			continue;
+		pct = strtol(q, NULL, 10);
+		if (pct >= 0 && pct <= 100)
+			j->info.percent = (int)pct;
+	}
+
+	/* spotdl reports each finished track; pick it up right away. */
+	if (strstr(line, "Downloaded") || strstr(line, "Skipping"))
+		j->scan = 1;
+}
+
+static void job_read(struct job *j)
+{
+	char buf[4096];
+	ssize_t n, i;
+
+	for (;;) {
+		n = read(j->fd, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return;		/* EAGAIN: nothing more for now */
+		if (n == 0) {
+			if (j->partial_len) {
+				j->partial[j->partial_len] = '\0';
+				job_line(j, j->partial);
+				j->partial_len = 0;
+			}
+			close(j->fd);
+			j->fd = -1;
+			return;
+		}
+
+		/* Progress bars redraw with \r, so that ends a line too. */
+		for (i = 0; i < n; i++) {
+			if (buf[i] == '\n' || buf[i] == '\r') {
+				j->partial[j->partial_len] = '\0';
+				job_line(j, j->partial);
+				j->partial_len = 0;
+			} else if (j->partial_len < sizeof(j->partial) - 1) {
+				j->partial[j->partial_len++] = buf[i];
+			}
+		}
+	}
+}
+
+/* Report the .mp3 files that appeared in the output directory. */
+static void job_scan(struct job *j, job_cb cb, void *arg)
+{
+	j->scan = 0;
+	snap_sync(j->outdir, j, cb, arg);
+}
+
+/**
+ * jobs_poll() - read job output, report new files and finished jobs.
+ *
+ * Return: the number of jobs still running.
+ */
+int jobs_poll(job_cb cb, void *arg)
+{
+	struct job *j;
+	int i, status, running = 0;
+	pid_t r;
+
+	for (i = 0; i < JOBS_MAX; i++) {
+		j = g_jobs[i];
+		if (!j || j->info.state != JOB_RUNNING)
+			continue;
+
+		if (j->fd >= 0)
+			job_read(j);
+		if (j->scan)
+			job_scan(j, cb, arg);
+
+		r = waitpid(j->pid, &status, WNOHANG);
+		if (r == 0 || (r < 0 && errno == EINTR)) {
+			running++;
+			continue;
+		}
+
+		/* Exited: drain what is left and take the last files. */
+		if (j->fd >= 0)
+			job_read(j);
+		job_scan(j, cb, arg);
+		j->pid = 0;
+		j->info.exit_code = r > 0 && WIFEXITED(status) ?
+				    WEXITSTATUS(status) : -1;
+		j->info.state = j->info.exit_code == 0 ? JOB_DONE : JOB_FAILED;
+		if (j->info.state == JOB_DONE)
+			j->info.percent = 100;
+		cb(&j->info, NULL, arg);
+	}
+	return running;
+}
+
+int jobs_running(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < JOBS_MAX; i++)
+		if (g_jobs[i] && g_jobs[i]->info.state == JOB_RUNNING)
+			n++;
+	return n;
+}
+
+/* Copy out up to max jobs, oldest first.  Return: how many. */
+size_t jobs_list(struct job_info *out, size_t max)
+{
+	size_t n = 0, i, k;
+	struct job_info tmp;
+
+	for (i = 0; i < JOBS_MAX && n < max; i++)
+		if (g_jobs[i])
+			out[n++] = g_jobs[i]->info;
+
+	/* Slots are reused, so sort by id; there are only a few. */
+	for (i = 1; i < n; i++) {
+		tmp = out[i];
+		for (k = i; k > 0 && out[k - 1].id > tmp.id; k--)
+			out[k] = out[k - 1];
+		out[k] = tmp;
+	}
+	return n;
+}
+
+/* Terminate running downloads and forget every job. */
+void jobs_shutdown(void)
+{
+	int i;
+
+	for (i = 0; i < JOBS_MAX; i++) {
+		if (!g_jobs[i])
+			continue;
+		if (g_jobs[i]->pid > 0) {
+			kill(-g_jobs[i]->pid, SIGTERM);
+			waitpid(g_jobs[i]->pid, NULL, 0);
+		}
+		job_free(g_jobs[i]);
+		g_jobs[i] = NULL;
+	}
+	snap_reset(&g_snap);
+}
@@ -0,0 +1,57 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * Background download jobs (webdownload).
+ *
+ * Each job is a spotdl process started with posix_spawnp() in its own
+ * process group, its stdout and stderr on a non-blocking pipe.  The UI
+ * thread calls jobs_poll() from the main loop: it reads whatever output
+ * is there, keeps the last line and any percentage in it as progress,
+ * hands over each .mp3 that is new in the output directory, and reaps
+ * jobs that exited.  "New" is judged against a snapshot of the inode
+ * numbers in that directory taken before the first job starts, so files
+ * already there are never reported and known ones are not even stat'd;
+ * the directory is only read again when its mtime changes.  Nothing in
+ * AppState is touched here.
+ *
+ * The program run is $LMP_SPOTDL if set, else "spotdl" from $PATH.
+ */
+
+#define JOBS_MAX		16	/* running and finished, oldest dropped */
+#define JOB_LINE_MAX		160
+
+enum job_state {
+	JOB_RUNNING,
+	JOB_DONE,
+	JOB_FAILED,
+};
+
+struct job_info {
+	int		id;
+	enum job_state	state;
+	int		percent;	/* from the output, -1 if none seen */
+	int		files;		/* tracks handed to the caller */
+	int		exit_code;
+	time_t		started;
+	char		query[128];
+	char		last_line[JOB_LINE_MAX];
+};
+
+/*
+ * Called by jobs_poll() with the path of each new file, then once with
+ * path NULL when the job has finished.
+ */
+typedef void (*job_cb)(const struct job_info *job, const char *path,
+		       void *arg);
+
+int jobs_start_download(const char *query, const char *outdir);
+int jobs_poll(job_cb cb, void *arg);
+int jobs_running(void);
+size_t jobs_list(struct job_info *out, size_t max);
+void jobs_shutdown(void);
+
+#endif /* JOBS_H */
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "journal.h"
+#include "config.h"
+#include "functions.h"
+#include "library_strings.h"
+#include "cJSON.h"
+
+#define JOURNAL_FILE		"journal.jsonl"
+#define JOURNAL_PATH_MAX	512
+/* Never compact before this many entries, however small the library. */
+#define JOURNAL_COMPACT_MIN	256
+
+/* Appends come from the UI thread, truncation from the config saver. */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_fd = -1;
+static unsigned long g_seq;	/* seq of the newest entry written or replayed */
+static unsigned long g_pending;	/* entries appended since the last snapshot */
+
+static int journal_open(void)
+{
+	char path[JOURNAL_PATH_MAX];
+
+	if (g_fd >= 0)
+		return 0;
+
+	config_ensure_dir();
+	config_file_path(path, sizeof(path), JOURNAL_FILE);
+
+	g_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	return g_fd >= 0 ? 0 : -1;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+/*
+ * Serialize op as a single line and append it.  Takes ownership of op.
+ * Once the journal holds more entries than the library has tracks a
+ * snapshot is scheduled, which keeps the cost per mutation amortized O(1).
+ */
+static void journal_append(const AppState *state, cJSON *op)
+{
+	char *line;
+	size_t len;
+	int compact = 0;
+
+	if (!op)
+		return;
+
+	pthread_mutex_lock(&g_lock);
+
+	cJSON_AddNumberToObject(op, "seq", (double)(g_seq + 1));
+	line = cJSON_PrintUnformatted(op);
+	cJSON_Delete(op);
+	if (!line)
+		goto out;
+
+	if (journal_open() != 0)
+		goto out;
+
+	len = strlen(line);
+	line[len] = '\n';
+	if (write_all(g_fd, line, len + 1) != 0)
+		goto out;
+
+	g_seq++;
+	g_pending++;
+
+	compact = g_pending >= JOURNAL_COMPACT_MIN &&
+		  g_pending > (unsigned long)state->track_count;
+out:
+	pthread_mutex_unlock(&g_lock);
+	free(line);
+
+	if (compact)
+		config_mark_dirty(state);
+}
+
+static cJSON *new_op(const char *name)
+{
+	cJSON *op = cJSON_CreateObject();
+
+	if (op)
+		cJSON_AddStringToObject(op, "op", name);
+	return op;
+}
+
+void journal_log_add(const AppState *state, int idx)
+{
+	cJSON *op;
+	char *path;
+
+	if (!state || idx < 0 || idx >= state->track_count)
+		return;
+
+	path = library_path_dup(state, idx);
+	op = new_op("add");
+	if (!op || !path) {
+		cJSON_Delete(op);
+		free(path);
+		return;
+	}
+	cJSON_AddNumberToObject(op, "id", (double)state->library[idx].id);
+	cJSON_AddStringToObject(op, "name", library_name(state, idx));
+	cJSON_AddStringToObject(op, "path", path);
+	free(path);
+	journal_append(state, op);
+}
+
+void journal_log_remove(const AppState *state, int idx)
+{
+	cJSON *op;
+
+	if (!state)
+		return;
+
+	op = new_op("rm");
+	if (!op)
+		return;
+	cJSON_AddNumberToObject(op, "idx", idx);
+	journal_append(state, op);
+}
+
+void journal_log_rename(const AppState *state, int idx)
+{
+	cJSON *op;
+
+	if (!state || idx < 0 || idx >= state->track_count)
+		return;
+
+	op = new_op("rename");
+	if (!op)
+		return;
+	cJSON_AddNumberToObject(op, "idx", idx);
+	cJSON_AddStringToObject(op, "name", library_name(state, idx));
+	journal_append(state, op);
+}
+
+void journal_log_playlist_new(const AppState *state, int pidx)
+{
+	cJSON *op;
+
+	if (!state || pidx < 0 || pidx >= state->playlist_count)
+		return;
+
+	op = new_op("plnew");
+	if (!op)
+		return;
+	cJSON_AddStringToObject(op, "name", state->playlists[pidx].name);
+	journal_append(state, op);
+}
+
+void journal_log_playlist_delete(const AppState *state, int pidx)
+{
+	cJSON *op;
+
+	if (!state)
+		return;
+
+	op = new_op("pldel");
+	if (!op)
+		return;
+	cJSON_AddNumberToObject(op, "pl", pidx);
+	journal_append(state, op);
+}
+
+void journal_log_playlist_add(const AppState *state, int pidx, int track_idx)
+{
+	cJSON *op;
+
+	if (!state)
+		return;
+
+	op = new_op("pladd");
+	if (!op)
+		return;
+	cJSON_AddNumberToObject(op, "pl", pidx);
+	cJSON_AddNumberToObject(op, "idx", track_idx);
+	journal_append(state, op);
+}
+
+void journal_log_playlist_remove(const AppState *state, int pidx, int pos)
+{
+	cJSON *op;
+
+	if (!state)
+		return;
+
+	op = new_op("plrm");
+	if (!op)
+		return;
+	cJSON_AddNumberToObject(op, "pl", pidx);
+	cJSON_AddNumberToObject(op, "pos", pos);
+	journal_append(state, op);
+}
+
+void journal_log_volume(const AppState *state)
+{
+	cJSON *op;
+
+	if (!state)
+		return;
+
+	op = new_op("vol");
+	if (!op)
+		return;
+	cJSON_AddNumberToObject(op, "v", state->current_volume);
+	journal_append(state, op);
+}
+
+void journal_log_last_track(const AppState *state)
+{
+	cJSON *op;
+
+	if (!state)
+		return;
+
+	op = new_op("last");
+	if (!op)
+		return;
+	cJSON_AddStringToObject(op, "path", state->current_track);
+	journal_append(state, op);
+}
+
+static int get_int(const cJSON *op, const char *key, int *out)
+{
+	const cJSON *v = cJSON_GetObjectItem(op, key);
+
+	if (!cJSON_IsNumber(v))
+		return -1;
+	*out = v->valueint;
+	return 0;
+}
+
+static uint64_t get_id(const cJSON *op, const char *key)
+{
+	const cJSON *v = cJSON_GetObjectItem(op, key);
+
+	if (!cJSON_IsNumber(v) || v->valuedouble < 1)
+		return 0;
+	return (uint64_t)v->valuedouble;
+}
+
+static const char *get_str(const cJSON *op, const char *key)
+{
+	const cJSON *v = cJSON_GetObjectItem(op, key);
+
+	if (!cJSON_IsString(v))
+		return NULL;
+	return v->valuestring;
+}
+
+static void apply_op(AppState *state, const cJSON *op)
+{
+	const char *kind = get_str(op, "op");
+	const char *s, *s2;
+	int a, b;
+
+	if (!kind)
+		return;
+
+	if (strcmp(kind, "add") == 0) {
+		s = get_str(op, "name");
+		s2 = get_str(op, "path");
+		if (s && s2)
+			library_add_track(state, s, s2, get_id(op, "id"));
+	} else if (strcmp(kind, "rm") == 0) {
+		if (get_int(op, "idx", &a) == 0)
+			library_remove_track(state, a);
+	} else if (strcmp(kind, "rename") == 0) {
+		s = get_str(op, "name");
+		if (s && get_int(op, "idx", &a) == 0)
+			library_rename_track(state, a, s);
+	} else if (strcmp(kind, "plnew") == 0) {
+		s = get_str(op, "name");
+		if (s)
+			playlist_create(state, s);
+	} else if (strcmp(kind, "pldel") == 0) {
+		if (get_int(op, "pl", &a) == 0)
+			playlist_delete(state, a);
+	} else if (strcmp(kind, "pladd") == 0) {
+		if (get_int(op, "pl", &a) == 0 && get_int(op, "idx", &b) == 0)
+			playlist_append_track(state, a, b);
+	} else if (strcmp(kind, "plrm") == 0) {
+		if (get_int(op, "pl", &a) == 0 && get_int(op, "pos", &b) == 0)
+			playlist_remove_at(state, a, b);
+	} else if (strcmp(kind, "vol") == 0) {
+		if (get_int(op, "v", &a) == 0 && a >= 0 && a <= 100)
+			state->current_volume = a;
+	} else if (strcmp(kind, "last") == 0) {
+		s = get_str(op, "path");
+		if (s) {
+			strncpy(state->current_track, s,
+				sizeof(state->current_track) - 1);
+			state->current_track[sizeof(state->current_track) - 1] = '\0';
+		}
+	}
+}
+
+/**
+ * journal_replay() - apply journal entries newer than the loaded snapshot.
+ *
+ * Entries with seq <= after_seq are already contained in config.json (the
+ * process died between publishing the snapshot and truncating the journal).
+ * A torn last line from a crash mid-append is cut off so that new entries
+ * are not appended after garbage.
+ *
+ * Return: number of entries applied, or -1 if the journal is unreadable.
+ */
+int journal_replay(AppState *state, unsigned long after_seq)
+{
+	char path[JOURNAL_PATH_MAX];
+	FILE *fp;
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	off_t good = 0;
+	int applied = 0, torn = 0;
+	cJSON *op, *seq;
+	unsigned long s;
+
+	g_seq = after_seq;
+	g_pending = 0;
+
+	if (!state)
+		return -1;
+
+	config_file_path(path, sizeof(path), JOURNAL_FILE);
+	fp = fopen(path, "rb");
+	if (!fp)
+		return errno == ENOENT ? 0 : -1;
+
+	while ((len = getline(&line, &cap, fp)) > 0) {
+		if (line[len - 1] != '\n') {
+			torn = 1;
+			break;
+		}
+
+		op = cJSON_Parse(line);
+		if (!op) {
+			torn = 1;
+			break;
+		}
+
+		good += len;
+		g_pending++;
+
+		seq = cJSON_GetObjectItem(op, "seq");
+		s = cJSON_IsNumber(seq) ? (unsigned long)seq->valuedouble : 0;
+		if (s > after_seq) {
+			apply_op(state, op);
+			applied++;
+			if (s > g_seq)
+				g_seq = s;
+		}
+		cJSON_Delete(op);
+	}
+
+	free(line);
+	fclose(fp);
+
+	if (torn && truncate(path, good) != 0)
+		return -1;
+
+	return applied;
+}
+
+unsigned long journal_seq(void)
+{
+	unsigned long seq;
+
+	pthread_mutex_lock(&g_lock);
+	seq = g_seq;
+	pthread_mutex_unlock(&g_lock);
+	return seq;
+}
+
+/*
+ * Called once a snapshot holding every entry up to seq is on disk.  If
+ * entries were appended meanwhile the journal is kept as is; replay skips
+ * the part the snapshot already covers.
+ */
+void journal_reset(unsigned long seq)
+{
+	char path[JOURNAL_PATH_MAX];
+
+	pthread_mutex_lock(&g_lock);
+	if (seq != g_seq)
+		goto out;
+
+	g_pending = 0;
+
+	if (g_fd >= 0 && ftruncate(g_fd, 0) == 0)
+		goto out;
+
+	config_file_path(path, sizeof(path), JOURNAL_FILE);
+	if (truncate(path, 0) != 0 && errno != ENOENT)
+		fprintf(stderr, "Failed to truncate journal: %s\n",
+			strerror(errno));
+out:
+	pthread_mutex_unlock(&g_lock);
+}
+
+void journal_close(void)
+{
+	pthread_mutex_lock(&g_lock);
+	if (g_fd >= 0) {
+		close(g_fd);
+		g_fd = -1;
+	}
+	pthread_mutex_unlock(&g_lock);
+}
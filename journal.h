@@ -0,0 +1,29 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "main.h"
+
+/*
+ * Append-only operation journal kept next to config.json.
+ *
+ * Every mutation appends one line instead of rewriting the whole config;
+ * a config.json snapshot is scheduled once the journal grows past the
+ * size of the library, and publishing it truncates the journal.
+ */
+
+void journal_log_add(const AppState *state, int idx);
+void journal_log_remove(const AppState *state, int idx);
+void journal_log_rename(const AppState *state, int idx);
+void journal_log_playlist_new(const AppState *state, int pidx);
+void journal_log_playlist_delete(const AppState *state, int pidx);
+void journal_log_playlist_add(const AppState *state, int pidx, int track_idx);
+void journal_log_playlist_remove(const AppState *state, int pidx, int pos);
+void journal_log_volume(const AppState *state);
+void journal_log_last_track(const AppState *state);
+
+int journal_replay(AppState *state, unsigned long after_seq);
+unsigned long journal_seq(void);
+void journal_reset(unsigned long seq);
+void journal_close(void);
+
+#endif /* JOURNAL_H */
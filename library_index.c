@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "library_index.h"
+#include "library_strings.h"
+
+/*
+ * Open addressing with linear probing.  Keys are not stored: a slot holds
+ * the library index + 1 and the key is read back from the library.  Names
+ * need not be unique, so each table is a multimap and lookups return the
+ * lowest matching library index, just like the linear scans they replace.
+ *
+ * If an allocation fails the table is dropped and lookups fall back to a
+ * linear scan until the next rebuild succeeds.
+ */
+
+#define SLOT_EMPTY	0
+#define SLOT_DELETED	(-1)
+#define INDEX_MIN_CAP	64
+
+enum index_key {
+	KEY_NAME,
+	KEY_PATH,
+	KEY_ID,
+};
+
+/* A lookup key: str for KEY_NAME and KEY_PATH, id for KEY_ID. */
+struct key {
+	const char	*str;
+	uint64_t	 id;
+};
+
+static const TrackIndex *index_of(const AppState *state, enum index_key key)
+{
+	switch (key) {
+	case KEY_NAME:
+		return &state->name_index;
+	case KEY_PATH:
+		return &state->path_index;
+	default:
+		return &state->id_index;
+	}
+}
+
+#define FNV_BASIS	2166136261u
+
+/* FNV-1a, continuing from h */
+static uint32_t hash_str(uint32_t h, const char *s)
+{
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* IDs are sequential; mix them so neighbours do not share probe runs. */
+static uint32_t hash_id(uint64_t id)
+{
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdULL;
+	id ^= id >> 33;
+	return (uint32_t)id;
+}
+
+static uint32_t hash_key(enum index_key key, const struct key *k)
+{
+	return key == KEY_ID ? hash_id(k->id) : hash_str(FNV_BASIS, k->str);
+}
+
+static int key_matches(const AppState *state, enum index_key key, int idx,
+		       const struct key *k)
+{
+	switch (key) {
+	case KEY_NAME:
+		return strcmp(library_name(state, idx), k->str) == 0;
+	case KEY_PATH:
+		return library_path_equals(state, idx, k->str);
+	default:
+		return state->library[idx].id == k->id;
+	}
+}
+
+/* Paths are stored split, so hash the pieces as if they were joined. */
+static uint32_t hash_track(const AppState *state, enum index_key key, int idx)
+{
+	const char *dir;
+	uint32_t h;
+
+	switch (key) {
+	case KEY_NAME:
+		return hash_str(FNV_BASIS, library_name(state, idx));
+	case KEY_PATH:
+		h = FNV_BASIS;
+		dir = library_dir(state, idx);
+		if (dir)
+			h = hash_str(hash_str(h, dir), "/");
+		return hash_str(h, library_file(state, idx));
+	default:
+		return hash_id(state->library[idx].id);
+	}
+}
+
+static void index_drop(TrackIndex *ix)
+{
+	free(ix->slots);
+	ix->slots = NULL;
+	ix->cap = 0;
+	ix->used = 0;
+}
+
+static void index_put(TrackIndex *ix, uint32_t h, int idx)
+{
+	uint32_t mask = (uint32_t)ix->cap - 1;
+	uint32_t i = h & mask;
+
+	while (ix->slots[i] > 0)
+		i = (i + 1) & mask;
+
+	if (ix->slots[i] == SLOT_EMPTY)
+		ix->used++;
+	ix->slots[i] = idx + 1;
+}
+
+/* Size the table for the whole library and insert every track. */
+static void index_build(AppState *state, enum index_key key)
+{
+	TrackIndex *ix = (TrackIndex *)index_of(state, key);
+	size_t cap = INDEX_MIN_CAP;
+	int i;
+
+	index_drop(ix);
+
+	while (cap < (size_t)state->track_count * 2 + 2) {
+		if (cap > (size_t)INT32_MAX / 2)
+			return;
+		cap *= 2;
+	}
+
+	ix->slots = calloc(cap, sizeof(*ix->slots));
+	if (!ix->slots)
+		return;
+	ix->cap = (int)cap;
+
+	for (i = 0; i < state->track_count; i++)
+		index_put(ix, hash_track(state, key, i), i);
+}
+
+static void index_insert(AppState *state, enum index_key key, int idx)
+{
+	TrackIndex *ix = (TrackIndex *)index_of(state, key);
+
+	/* Keep the load factor (tombstones included) at or below 1/2. */
+	if (!ix->slots || (ix->used + 1) * 2 > ix->cap) {
+		index_build(state, key);
+		return;
+	}
+	index_put(ix, hash_track(state, key, idx), idx);
+}
+
+static void index_erase(AppState *state, enum index_key key, int idx)
+{
+	TrackIndex *ix = (TrackIndex *)index_of(state, key);
+	uint32_t mask, i;
+
+	if (!ix->slots)
+		return;
+
+	mask = (uint32_t)ix->cap - 1;
+	i = hash_track(state, key, idx) & mask;
+
+	while (ix->slots[i] != SLOT_EMPTY) {
+		if (ix->slots[i] == idx + 1) {
+			ix->slots[i] = SLOT_DELETED;
+			return;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+static int index_find(const AppState *state, enum index_key key,
+		      const struct key *k)
+{
+	const TrackIndex *ix = index_of(state, key);
+	uint32_t mask, i;
+	int best = -1, v, t;
+
+	if (!ix->slots) {
+		for (t = 0; t < state->track_count; t++) {
+			if (key_matches(state, key, t, k))
+				return t;
+		}
+		return -1;
+	}
+
+	mask = (uint32_t)ix->cap - 1;
+	i = hash_key(key, k) & mask;
+
+	while ((v = ix->slots[i]) != SLOT_EMPTY) {
+		if (v > 0 && v <= state->track_count &&
+		    (best < 0 || v - 1 < best) &&
+		    key_matches(state, key, v - 1, k))
+			best = v - 1;
+		i = (i + 1) & mask;
+	}
+	return best;
+}
+
+int library_find_by_name(const AppState *state, const char *name)
+{
+	struct key k = { name, 0 };
+
+	if (!state || !name)
+		return -1;
+	return index_find(state, KEY_NAME, &k);
+}
+
+int library_find_by_path(const AppState *state, const char *path)
+{
+	struct key k = { path, 0 };
+
+	if (!state || !path)
+		return -1;
+	return index_find(state, KEY_PATH, &k);
+}
+
+int library_find_by_id(const AppState *state, uint64_t id)
+{
+	struct key k = { NULL, id };
+
+	if (!state || id == 0)
+		return -1;
+	return index_find(state, KEY_ID, &k);
+}
+
+/* idx must already be stored in state->library. */
+void library_index_insert(AppState *state, int idx)
+{
+	index_insert(state, KEY_NAME, idx);
+	index_insert(state, KEY_PATH, idx);
+	index_insert(state, KEY_ID, idx);
+}
+
+/* Call before Track.name changes ... */
+void library_index_erase_name(AppState *state, int idx)
+{
+	index_erase(state, KEY_NAME, idx);
+}
+
+/* ... and this once it has. */
+void library_index_insert_name(AppState *state, int idx)
+{
+	index_insert(state, KEY_NAME, idx);
+}
+
+void library_index_rebuild(AppState *state)
+{
+	index_build(state, KEY_NAME);
+	index_build(state, KEY_PATH);
+	index_build(state, KEY_ID);
+}
+
+void library_index_free(AppState *state)
+{
+	index_drop(&state->name_index);
+	index_drop(&state->path_index);
+	index_drop(&state->id_index);
+}
@@ -0,0 +1,24 @@
+#ifndef LIBRARY_INDEX_H
+#define LIBRARY_INDEX_H
+
+#include "main.h"
+
+/*
+ * Hash indexes from track names, paths and Track.id to library slots.
+ *
+ * The library mutation helpers in functions.c keep them up to date; code
+ * that fills state->library directly (the binary snapshot loader) calls
+ * library_index_rebuild() afterwards.
+ */
+
+int library_find_by_name(const AppState *state, const char *name);
+int library_find_by_path(const AppState *state, const char *path);
+int library_find_by_id(const AppState *state, uint64_t id);
+
+void library_index_insert(AppState *state, int idx);
+void library_index_erase_name(AppState *state, int idx);
+void library_index_insert_name(AppState *state, int idx);
+void library_index_rebuild(AppState *state);
+void library_index_free(AppState *state);
+
+#endif /* LIBRARY_INDEX_H */
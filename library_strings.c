@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "library_strings.h"
+#include "fold.h"
+
+#define ARENA_MIN_CAP		4096
+#define DIRS_MIN_CAP		16
+#define DIR_SLOTS_MIN_CAP	64
+#define KEY_BUF_SIZE		256
+
+/* FNV-1a */
+static uint32_t hash_mem(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* Make room for @need more bytes; offsets have to fit in 32 bits. */
+static int arena_grow(TrackStrings *s, size_t need)
+{
+	size_t cap = s->cap ? s->cap : ARENA_MIN_CAP;
+	char *tmp;
+
+	if (need > UINT32_MAX - s->len)
+		return -1;
+	need += s->len;
+	if (need <= s->cap)
+		return 0;
+
+	while (cap < need)
+		cap = cap > UINT32_MAX / 2 ? UINT32_MAX : cap * 2;
+	tmp = realloc(s->arena, cap);
+	if (!tmp)
+		return -1;
+	s->arena = tmp;
+	s->cap = (uint32_t)cap;
+	return 0;
+}
+
+/* Append str[0..len) and a NUL.  str must not point into the arena. */
+static int arena_put(TrackStrings *s, const char *str, size_t len,
+		     uint32_t *off)
+{
+	if (arena_grow(s, len + 1) != 0)
+		return -1;
+	*off = s->len;
+	memcpy(s->arena + s->len, str, len);
+	s->arena[s->len + len] = '\0';
+	s->len += (uint32_t)len + 1;
+	return 0;
+}
+
+static void slot_put(uint32_t *slots, uint32_t cap, uint32_t h, uint32_t dir)
+{
+	uint32_t mask = cap - 1;
+	uint32_t i = h & mask;
+
+	while (slots[i])
+		i = (i + 1) & mask;
+	slots[i] = dir + 1;
+}
+
+static uint32_t hash_dir(const TrackStrings *s, uint32_t dir)
+{
+	const char *d = s->arena + s->dirs[dir];
+
+	return hash_mem(d, strlen(d));
+}
+
+/* Room for @more directories, keeping the hash at most half full. */
+static int dirs_reserve(TrackStrings *s, uint32_t more)
+{
+	size_t need = (size_t)s->dir_count + more, cap;
+	uint32_t *tmp, i;
+
+	if (need > UINT32_MAX / 4)
+		return -1;
+
+	if (need > s->dir_cap) {
+		cap = s->dir_cap ? s->dir_cap : DIRS_MIN_CAP;
+		while (cap < need)
+			cap *= 2;
+		tmp = realloc(s->dirs, cap * sizeof(*s->dirs));
+		if (!tmp)
+			return -1;
+		s->dirs = tmp;
+		s->dir_cap = (uint32_t)cap;
+	}
+
+	if (need * 2 > s->dir_slots_cap) {
+		cap = s->dir_slots_cap ? s->dir_slots_cap : DIR_SLOTS_MIN_CAP;
+		while (cap < need * 2)
+			cap *= 2;
+		tmp = calloc(cap, sizeof(*tmp));
+		if (!tmp)
+			return -1;
+		for (i = 0; i < s->dir_count; i++)
+			slot_put(tmp, (uint32_t)cap, hash_dir(s, i), i);
+		free(s->dir_slots);
+		s->dir_slots = tmp;
+		s->dir_slots_cap = (uint32_t)cap;
+	}
+	return 0;
+}
+
+/* Find dir[0..len) among the interned directories, adding it if new. */
+static int dir_intern(TrackStrings *s, const char *dir, size_t len,
+		      uint32_t *out)
+{
+	uint32_t h = hash_mem(dir, len);
+	uint32_t mask, i, v, off;
+	const char *d;
+
+	if (s->dir_slots) {
+		mask = s->dir_slots_cap - 1;
+		for (i = h & mask; (v = s->dir_slots[i]) != 0; i = (i + 1) & mask) {
+			d = s->arena + s->dirs[v - 1];
+			if (strncmp(d, dir, len) == 0 && d[len] == '\0') {
+				*out = v - 1;
+				return 0;
+			}
+		}
+	}
+
+	if (dirs_reserve(s, 1) != 0 || arena_put(s, dir, len, &off) != 0)
+		return -1;
+	s->dirs[s->dir_count] = off;
+	slot_put(s->dir_slots, s->dir_slots_cap, h, s->dir_count);
+	*out = s->dir_count++;
+	return 0;
+}
+
+const char *library_name(const AppState *state, int idx)
+{
+	return state->strings.arena + state->library[idx].name;
+}
+
+/* Return: the directory of the track's path, or NULL if it has none. */
+const char *library_dir(const AppState *state, int idx)
+{
+	const TrackStrings *s = &state->strings;
+	uint32_t dir = state->library[idx].dir;
+
+	return dir == TRACK_NO_DIR ? NULL : s->arena + s->dirs[dir];
+}
+
+/* The name folded for searching; see fold.h. */
+const char *library_key(const AppState *state, int idx)
+{
+	return state->strings.arena + state->library[idx].key;
+}
+
+/* The rest of the path after library_dir() and its '/'. */
+const char *library_file(const AppState *state, int idx)
+{
+	return state->strings.arena + state->library[idx].file;
+}
+
+/**
+ * library_path() - put the track's path together in @buf.
+ *
+ * Return: its length, as snprintf() does; @buf was too small if that is
+ * @size or more.
+ */
+size_t library_path(const AppState *state, int idx, char *buf, size_t size)
+{
+	const char *dir = library_dir(state, idx);
+	int n;
+
+	if (dir)
+		n = snprintf(buf, size, "%s/%s", dir, library_file(state, idx));
+	else
+		n = snprintf(buf, size, "%s", library_file(state, idx));
+	return n < 0 ? 0 : (size_t)n;
+}
+
+/* Return: the track's path in a malloc'd string, or NULL. */
+char *library_path_dup(const AppState *state, int idx)
+{
+	size_t n = library_path(state, idx, NULL, 0) + 1;
+	char *p = malloc(n);
+
+	if (p)
+		library_path(state, idx, p, n);
+	return p;
+}
+
+/* Compare without putting the path together first. */
+int library_path_equals(const AppState *state, int idx, const char *path)
+{
+	const char *dir = library_dir(state, idx);
+	size_t n;
+
+	if (dir) {
+		n = strlen(dir);
+		if (strncmp(path, dir, n) != 0 || path[n] != '/')
+			return 0;
+		path += n + 1;
+	}
+	return strcmp(path, library_file(state, idx)) == 0;
+}
+
+/* Make room for @bytes more of names and paths up front. */
+int track_strings_reserve(TrackStrings *s, size_t bytes)
+{
+	return arena_grow(s, bytes);
+}
+
+/*
+ * The key for name[0..len), in buf if it fits and otherwise malloc'd.
+ * Return: NULL if out of memory.
+ */
+static char *make_key(const char *name, size_t len, char *buf,
+		      size_t *key_len)
+{
+	char *key = len < KEY_BUF_SIZE ? buf : malloc(len + 1);
+
+	if (key)
+		*key_len = fold_key(name, key);
+	return key;
+}
+
+/* Does the key differ from the name, and so need bytes of its own? */
+static int key_stored(const char *name, size_t len, const char *key,
+		      size_t key_len)
+{
+	return key_len != len || memcmp(key, name, len) != 0;
+}
+
+/* Bytes a track's name and key take up in the arena. */
+static uint32_t name_bytes(const TrackStrings *s, const Track *t)
+{
+	uint32_t n = (uint32_t)strlen(s->arena + t->name) + 1;
+
+	if (t->key != t->name)
+		n += (uint32_t)strlen(s->arena + t->key) + 1;
+	return n;
+}
+
+/* Store the strings of a new track; t is left alone on failure. */
+int track_strings_add(TrackStrings *s, Track *t, const char *name,
+		      const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	const char *file = slash ? slash + 1 : path;
+	size_t name_len = strlen(name), file_len = strlen(file), key_len;
+	uint32_t dir = TRACK_NO_DIR;
+	char buf[KEY_BUF_SIZE], *key;
+	int own_key, ret = -1;
+
+	key = make_key(name, name_len, buf, &key_len);
+	if (!key)
+		return -1;
+	own_key = key_stored(name, name_len, key, key_len);
+
+	if (slash && dir_intern(s, path, (size_t)(slash - path), &dir) != 0)
+		goto out;
+	if (arena_grow(s, name_len + file_len + 2 +
+			  (own_key ? key_len + 1 : 0)) != 0)
+		goto out;
+
+	(void)arena_put(s, name, name_len, &t->name);
+	t->key = t->name;
+	if (own_key)
+		(void)arena_put(s, key, key_len, &t->key);
+	(void)arena_put(s, file, file_len, &t->file);
+	t->dir = dir;
+	ret = 0;
+out:
+	if (key != buf)
+		free(key);
+	return ret;
+}
+
+int track_strings_rename(TrackStrings *s, Track *t, const char *name)
+{
+	uint32_t old_bytes = name_bytes(s, t), off, key_off;
+	size_t name_len = strlen(name), key_len;
+	char buf[KEY_BUF_SIZE], *key;
+	int own_key, ret = -1;
+
+	key = make_key(name, name_len, buf, &key_len);
+	if (!key)
+		return -1;
+	own_key = key_stored(name, name_len, key, key_len);
+
+	if (arena_grow(s, name_len + 1 + (own_key ? key_len + 1 : 0)) != 0)
+		goto out;
+	(void)arena_put(s, name, name_len, &off);
+	key_off = off;
+	if (own_key)
+		(void)arena_put(s, key, key_len, &key_off);
+
+	s->garbage += old_bytes;
+	t->name = off;
+	t->key = key_off;
+	ret = 0;
+out:
+	if (key != buf)
+		free(key);
+	return ret;
+}
+
+/* The track is going away; its strings become garbage. */
+void track_strings_drop(TrackStrings *s, const Track *t)
+{
+	s->garbage += name_bytes(s, t) +
+		      (uint32_t)strlen(s->arena + t->file) + 1;
+}
+
+void track_strings_free(TrackStrings *s)
+{
+	free(s->arena);
+	free(s->dirs);
+	free(s->dir_slots);
+	memset(s, 0, sizeof(*s));
+}
+
+/**
+ * library_strings_compact() - repack the arena once half of it is garbage.
+ *
+ * Copies the strings of every track into a fresh arena, in library order,
+ * and interns only the directories still in use.  Everything is allocated
+ * before any track is touched, so on failure the old arena stays as is.
+ *
+ * Return: 0 on success or if there was nothing to do, -1 on failure.
+ */
+int library_strings_compact(AppState *state)
+{
+	TrackStrings *s = &state->strings, n;
+	const char *d;
+	Track *t;
+	int own_key, i;
+
+	if (!s->garbage || (size_t)s->garbage * 2 < s->len)
+		return 0;
+
+	memset(&n, 0, sizeof(n));
+	if (arena_grow(&n, s->len - s->garbage) != 0 ||
+	    dirs_reserve(&n, s->dir_count) != 0) {
+		track_strings_free(&n);
+		return -1;
+	}
+
+	for (i = 0; i < state->track_count; i++) {
+		t = &state->library[i];
+		if (t->dir != TRACK_NO_DIR) {
+			d = s->arena + s->dirs[t->dir];
+			(void)dir_intern(&n, d, strlen(d), &t->dir);
+		}
+		own_key = t->key != t->name;
+		d = s->arena + t->name;
+		(void)arena_put(&n, d, strlen(d), &t->name);
+		if (own_key) {
+			d = s->arena + t->key;
+			(void)arena_put(&n, d, strlen(d), &t->key);
+		} else {
+			t->key = t->name;
+		}
+		d = s->arena + t->file;
+		(void)arena_put(&n, d, strlen(d), &t->file);
+	}
+
+	track_strings_free(s);
+	*s = n;
+	return 0;
+}
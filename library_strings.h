@@ -0,0 +1,40 @@
+#ifndef LIBRARY_STRINGS_H
+#define LIBRARY_STRINGS_H
+
+#include <stddef.h>
+
+#include "main.h"
+
+/*
+ * Storage for Track names and paths.
+ *
+ * Every string is appended once to one growing arena and a Track keeps
+ * offsets into it.  A path is split at its last '/': the directory part
+ * is interned, so the thousands of tracks in one album or download folder
+ * share a single copy of it, and only the file name is stored per track.
+ * Next to each name is its search key (fold.h), unless that is the name
+ * itself, as it is for names already in lower case ASCII.
+ * Renamed and removed tracks leave their old strings behind as garbage
+ * until library_strings_compact() packs the arena again.
+ *
+ * Pointers returned by the readers point into the arena and are only good
+ * until the library is next changed.
+ */
+
+const char *library_name(const AppState *state, int idx);
+const char *library_key(const AppState *state, int idx);
+const char *library_dir(const AppState *state, int idx);
+const char *library_file(const AppState *state, int idx);
+size_t library_path(const AppState *state, int idx, char *buf, size_t size);
+char *library_path_dup(const AppState *state, int idx);
+int library_path_equals(const AppState *state, int idx, const char *path);
+
+int track_strings_reserve(TrackStrings *s, size_t bytes);
+int track_strings_add(TrackStrings *s, Track *t, const char *name,
+		      const char *path);
+int track_strings_rename(TrackStrings *s, Track *t, const char *name);
+void track_strings_drop(TrackStrings *s, const Track *t);
+void track_strings_free(TrackStrings *s);
+int library_strings_compact(AppState *state);
+
+#endif /* LIBRARY_STRINGS_H */
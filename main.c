@@ -10,18 +10,61 @@
 #include <strings.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include "handle_command.h"
 #include "config.h"
 #include "functions.h"
 #include "main.h"
+#include "journal.h"
+#include "library_index.h"
+#include "library_strings.h"
+#include "search_index.h"
+#include "fold.h"
+#include "scanner.h"
+#include "probe.h"
+#include "events.h"
+#include "jobs.h"
 #include <locale.h>
 
 /* Prototypes */
 static void handle_command(AppState *state);
+static void ui_init(void);
 void draw_ui(AppState *state);
 void play_track(AppState *state, const char *track_path);
 
+/* What the player will switch to when the current track ends */
+static struct {
+  int queued;
+  int playlist_pos;
+  char path[PATH_MAX];
+} g_next;
+
+/*
+ * Search-as-you-type pane ('/').  sets[i] holds the matches for the first
+ * i bytes of the query; each byte typed only re-checks the previous set,
+ * and backspace goes back to the one before without searching at all.
+ * An empty query shows the whole library.
+ *
+ * Refining is only right while the folded query (fold.h) grows at its
+ * end, so a query whose key does not start with the previous one is
+ * searched afresh.  Nothing is searched in the middle of a UTF-8
+ * character: level[i] is then the earlier i whose set stands for it.
+ */
+#define FILTER_QUERY_MAX 255
+
+static struct {
+  int active;
+  int dirty;                /* the pane needs drawing */
+  int track_count;          /* library size the sets were made for */
+  int len;
+  char query[FILTER_QUERY_MAX + 1];
+  int *sets[FILTER_QUERY_MAX + 1];
+  int counts[FILTER_QUERY_MAX + 1];
+  int level[FILTER_QUERY_MAX + 1];
+  int selected, top;
+} g_filter;
+
 /* Helpers for addholder */
 static int has_mp3_ext(const char *name) {
   const char *dot = strrchr(name, '.');
@@ -54,84 +97,435 @@ static void join_path(char *dst, size_t dstsz, const char *dir,
     snprintf(dst, dstsz, "%s/%s", dir, name);
 }
 
-static int track_name_exists(const AppState *state, const char *name) {
-  int i;
 
-  for (i = 0; i < state->track_count; i++) {
-    if (strcmp(state->library[i].name, name) == 0)
-      return 1;
+
+void play_track(AppState *state, const char *track_path) {
+  if (access(track_path, F_OK) != 0) {
+    snprintf(state->message, sizeof(state->message),
+             "Error: File not found: %s", track_path);
+  } else {
+    g_next.queued = 0;
+    player_load_file(track_path);
+    player_play();
+    state->track_duration = library_cached_duration(state, track_path);
+    library_set_current(state, track_path);
+
+    snprintf(state->message, sizeof(state->message), "Started playing: %s",
+             library_current_name(state));
+
+    /* Persist last track path */
+    journal_log_last_track(state);
   }
-  return 0;
 }
 
-static int track_path_exists(const AppState *state, const char *path) {
-  int i;
+/*
+ * Work out what follows the current track, per the mode and playlist.
+ * Return: buf holding the path to play (with *pl_pos its playlist
+ * position), or NULL when playback should stop.
+ */
+static const char *pick_next_track(AppState *state, int *pl_pos, char *buf,
+                                   size_t size) {
+  *pl_pos = state->playing_track_index_in_playlist;
+
+  if (strcmp(state->mode, "repeat-one") == 0) {
+    snprintf(buf, size, "%s", state->current_track);
+    return buf;
+  }
 
-  for (i = 0; i < state->track_count; i++) {
-    if (strcmp(state->library[i].path, path) == 0)
-      return 1;
+  if (strcmp(state->mode, "shuffle") == 0) {
+    if (state->track_count <= 0)
+      return NULL;
+    if (library_path(state, rand() % state->track_count, buf, size) >= size)
+      return NULL;
+    return buf;
   }
-  return 0;
+
+  if (state->playing_playlist_index != -1) {
+    Playlist *pl = &state->playlists[state->playing_playlist_index];
+    int pos = *pl_pos;
+    int lib_idx;
+
+    if (!pl->track_indices || pl->track_count <= 0)
+      return NULL;
+
+    if (strcmp(state->mode, "repeat-all") == 0 && pos >= pl->track_count - 1)
+      pos = 0;
+    else
+      pos++;
+
+    if (pos >= pl->track_count)
+      return NULL;
+    lib_idx = pl->track_indices[pos];
+    if (lib_idx < 0 || lib_idx >= state->track_count)
+      return NULL;
+
+    if (library_path(state, lib_idx, buf, size) >= size)
+      return NULL;
+    *pl_pos = pos;
+    return buf;
+  }
+
+  return NULL;
 }
 
+static void next_track_message(AppState *state) {
+  if (strcmp(state->mode, "repeat-one") == 0)
+    snprintf(state->message, sizeof(state->message), "Repeating track.");
+  else if (strcmp(state->mode, "shuffle") == 0)
+    snprintf(state->message, sizeof(state->message),
+             "Shuffling to next track.");
+  else if (state->playing_playlist_index != -1)
+    snprintf(state->message, sizeof(state->message),
+             "Now playing next track in '%s'",
+             state->playlists[state->playing_playlist_index].name);
+}
 
+/* The current track stopped without a queued successor: start the next. */
+static void advance_track(AppState *state) {
+  char path[PATH_MAX];
+  int pos;
+
+  g_next.queued = 0;
+  if (!pick_next_track(state, &pos, path, sizeof(path))) {
+    if (state->playing_playlist_index != -1)
+      snprintf(state->message, sizeof(state->message),
+               "Playlist '%s' finished.",
+               state->playlists[state->playing_playlist_index].name);
+    else
+      snprintf(state->message, sizeof(state->message), "Playback Finished.");
+    state->playing_playlist_index = -1;
+    state->current_track[0] = '\0';
+    state->track_duration = 0.0;
+    return;
+  }
 
-void play_track(AppState *state, const char *track_path) {
-  if (access(track_path, F_OK) != 0) {
+  state->playing_track_index_in_playlist = pos;
+  play_track(state, path);
+  next_track_message(state);
+}
+
+/* Play library slot idx. */
+void play_library_track(AppState *state, int idx) {
+  char path[PATH_MAX];
+
+  if (library_path(state, idx, path, sizeof(path)) >= sizeof(path)) {
     snprintf(state->message, sizeof(state->message),
-             "Error: File not found: %s", track_path);
-  } else {
-    const char *track_display_name = NULL;
-    int i;
+             "Error: Path too long: %s", library_file(state, idx));
+    return;
+  }
+  play_track(state, path);
+}
 
-    player_load_file(track_path);
-    player_play();
-    state->track_duration = get_mp3_duration(track_path);
-    strncpy(state->current_track, track_path, sizeof(state->current_track) - 1);
-    state->current_track[sizeof(state->current_track) - 1] = '\0';
-
-    for (i = 0; i < state->track_count; i++) {
-      if (strcmp(state->library[i].path, state->current_track) == 0) {
-        track_display_name = state->library[i].name;
-        break;
-      }
+/* Seconds before the end of a track at which its successor is opened. */
+#define PRELOAD_SECONDS 10.0
+
+static int near_track_end(AppState *state) {
+  if (player_get_status() != PLAYER_PLAYING)
+    return 0;
+  if (state->track_duration <= 0.0)
+    return 1;
+  return state->track_duration - player_get_current_position() <
+         PRELOAD_SECONDS;
+}
+
+/* Hand the next track to the player ahead of time for a gapless switch. */
+static void queue_next_track(AppState *state) {
+  int pos;
+
+  if (!pick_next_track(state, &pos, g_next.path, sizeof(g_next.path)))
+    return;
+  g_next.playlist_pos = pos;
+
+  /* Still set when it cannot be queued, so this is tried once per track. */
+  g_next.queued = 1;
+  if (player_queue_next(g_next.path) != 0)
+    g_next.path[0] = '\0';
+}
+
+/* The player moved on to the queued track by itself. */
+static void next_track_started(AppState *state) {
+  g_next.queued = 0;
+  if (!g_next.path[0])
+    return;
+
+  library_set_current(state, g_next.path);
+  if (state->playing_playlist_index != -1 &&
+      g_next.playlist_pos <
+          state->playlists[state->playing_playlist_index].track_count)
+    state->playing_track_index_in_playlist = g_next.playlist_pos;
+  state->track_duration = library_cached_duration(state, state->current_track);
+
+  snprintf(state->message, sizeof(state->message), "Started playing: %s",
+           library_current_name(state));
+
+  journal_log_last_track(state);
+}
+
+/* Redraw period while a track plays; the progress bar moves in seconds. */
+#define PROGRESS_TICK_MS 500
+/* Check on an import or the duration probe this often. */
+#define BACKGROUND_TICK_MS 200
+
+static int background_busy(void) {
+  struct scan_status st;
+
+  return scanner_status(&st) || probe_pending() > 0 || jobs_running() > 0;
+}
+
+static int filter_count(void) {
+  int lv = g_filter.level[g_filter.len];
+
+  return lv ? g_filter.counts[lv] : g_filter.track_count;
+}
+
+/* Library slot of the i-th match. */
+static int filter_slot(int i) {
+  int lv = g_filter.level[g_filter.len];
+
+  return lv ? g_filter.sets[lv][i] : i;
+}
+
+static void filter_reset(void) {
+  for (int i = 1; i <= g_filter.len; i++)
+    if (g_filter.level[i] == i)
+      free(g_filter.sets[i]);
+  g_filter.len = 0;
+  g_filter.query[0] = '\0';
+  g_filter.selected = g_filter.top = 0;
+  g_filter.dirty = 1;
+}
+
+/* Does s[0..len) stop in the middle of a UTF-8 character? */
+static int utf8_incomplete(const char *s, int len) {
+  int i = len, need;
+  unsigned char c;
+
+  while (i > 0 && len - i < 3 && ((unsigned char)s[i - 1] & 0xc0) == 0x80)
+    i--;
+  if (i == 0)
+    return 0;
+  c = (unsigned char)s[i - 1];
+  need = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+  return len - (i - 1) < need;
+}
+
+/* Type one more byte of the query. */
+static void filter_push(AppState *state, char c) {
+  char key[FILTER_QUERY_MAX + 1], prev[FILTER_QUERY_MAX + 1];
+  char prev_key[FILTER_QUERY_MAX + 1];
+  int len = g_filter.len, lv = g_filter.level[len], n;
+  size_t prev_len;
+  int *set = NULL;
+
+  if (len == FILTER_QUERY_MAX)
+    return;
+
+  g_filter.query[len] = c;
+  g_filter.query[len + 1] = '\0';
+  if (utf8_incomplete(g_filter.query, len + 1)) {
+    g_filter.len = len + 1;
+    g_filter.level[len + 1] = lv;
+    g_filter.dirty = 1;
+    return;
+  }
+
+  /* The set for lv can only be narrowed if its key starts this one. */
+  fold_key(g_filter.query, key);
+  memcpy(prev, g_filter.query, (size_t)lv);
+  prev[lv] = '\0';
+  prev_len = fold_key(prev, prev_key);
+  if (lv == 0 || strncmp(key, prev_key, prev_len) != 0)
+    n = library_search(state, g_filter.query, &set);
+  else
+    n = library_search_refine(state, g_filter.query, g_filter.sets[lv],
+                              g_filter.counts[lv], &set);
+  if (n < 0) {
+    g_filter.query[len] = '\0';
+    snprintf(state->message, sizeof(state->message),
+             "Search failed (out of memory).");
+    return;
+  }
+
+  g_filter.len = len + 1;
+  g_filter.level[len + 1] = len + 1;
+  g_filter.sets[len + 1] = set;
+  g_filter.counts[len + 1] = n;
+  g_filter.selected = g_filter.top = 0;
+  g_filter.dirty = 1;
+}
+
+/* Back to the previous character's matches; UTF-8 goes a whole character. */
+static void filter_pop(void) {
+  unsigned char c;
+
+  while (g_filter.len > 0) {
+    c = (unsigned char)g_filter.query[--g_filter.len];
+    if (g_filter.level[g_filter.len + 1] == g_filter.len + 1)
+      free(g_filter.sets[g_filter.len + 1]);
+    g_filter.query[g_filter.len] = '\0';
+    if ((c & 0xc0) != 0x80)
+      break;
+  }
+  g_filter.selected = g_filter.top = 0;
+  g_filter.dirty = 1;
+}
+
+/* Tracks were imported meanwhile: search again for what was typed. */
+static void filter_sync(AppState *state) {
+  char query[FILTER_QUERY_MAX + 1];
+
+  if (g_filter.track_count == state->track_count)
+    return;
+
+  strcpy(query, g_filter.query);
+  filter_reset();
+  g_filter.track_count = state->track_count;
+  for (int i = 0; query[i]; i++)
+    filter_push(state, query[i]);
+}
+
+void search_filter_open(AppState *state) {
+  filter_reset();
+  g_filter.active = 1;
+  g_filter.track_count = state->track_count;
+  ui_invalidate();
+}
+
+static void filter_close(void) {
+  filter_reset();
+  g_filter.active = 0;
+  ui_invalidate();
+}
+
+static void filter_key(AppState *state, int ch) {
+  int rows = getmaxy(stdscr), page, count;
+
+  page = rows - 8 > 1 ? rows - 8 : 1;
+  filter_sync(state);
+  count = filter_count();
+
+  switch (ch) {
+  case 27: /* Esc */
+    filter_close();
+    return;
+  case '\n':
+  case '\r':
+  case KEY_ENTER:
+    if (count > 0) {
+      int slot = filter_slot(g_filter.selected);
+
+      filter_close();
+      state->playing_playlist_index = -1;
+      state->playing_track_index_in_playlist = 0;
+      play_library_track(state, slot);
     }
+    return;
+  case KEY_BACKSPACE:
+  case 127:
+  case 8:
+    filter_pop();
+    return;
+  case KEY_UP:
+    g_filter.selected--;
+    break;
+  case KEY_DOWN:
+    g_filter.selected++;
+    break;
+  case KEY_PPAGE:
+    g_filter.selected -= page;
+    break;
+  case KEY_NPAGE:
+    g_filter.selected += page;
+    break;
+  default:
+    /* Printable ASCII and the bytes of UTF-8 characters */
+    if ((ch >= ' ' && ch < 127) || (ch >= 0x80 && ch <= 0xff))
+      filter_push(state, (char)ch);
+    return;
+  }
 
-    if (!track_display_name)
-      track_display_name = state->current_track;
+  if (g_filter.selected >= count)
+    g_filter.selected = count - 1;
+  if (g_filter.selected < 0)
+    g_filter.selected = 0;
+  g_filter.dirty = 1;
+}
 
-    snprintf(state->message, sizeof(state->message), "Started playing: %s",
-             track_display_name);
+static void handle_key(AppState *state, int ch) {
+  int rows, cols;
 
-    /* Persist last track path, etc. */
-    config_save(state);
+  if (g_filter.active) {
+    filter_key(state, ch);
+    return;
+  }
+
+  switch (ch) {
+  case 'q':
+    state->is_running = 0;
+    break;
+  case '/':
+    search_filter_open(state);
+    break;
+  case ':':
+    getmaxyx(stdscr, rows, cols);
+    echo();
+    strncpy(state->command_buffer, "", sizeof(state->command_buffer) - 1);
+
+    attron(A_REVERSE);
+    mvprintw(rows - 1, 0, ":");
+    for (int i = 1; i < cols; i++)
+      printw(" ");
+    move(rows - 1, 1);
+    attroff(A_REVERSE);
+
+    timeout(-1);
+    getstr(state->command_buffer);
+    timeout(0);
+
+    noecho();
+    clear();
+    refresh();
+
+    handle_command(state);
+    ui_invalidate();
+
+    /* The command may have changed what comes next; pick it again. */
+    if (g_next.queued) {
+      player_clear_next();
+      g_next.queued = 0;
+    }
+    break;
   }
 }
 
 int main(int argc, char *argv[]) {
   AppState state = {0};
-  int ch, rows, cols;
+  int ch, ev;
 
   srand(time(NULL));
 
-  if (player_init() != 0) {
+  config_audio_defaults(&state.audio);
+  if (events_init() != 0 || player_init(&state.audio) != 0) {
     fprintf(stderr, "Failed to initialize the audio player. Exiting.\n");
     return 1;
   }
 
   setlocale(LC_ALL, "");
-  initscr();
+  ui_init();
 
   /* Defaults before load */
   state.current_volume = 100;
+  state.save_delay_ms = CONFIG_DEFAULT_SAVE_DELAY_MS;
+  state.binary_snapshot = 1;
   state.is_running = 1;
   state.playing_playlist_index = -1;
   state.playing_track_index_in_playlist = 0;
+  state.current_track_index = -1;
   strncpy(state.mode, "no-repeat", sizeof(state.mode) - 1);
 
   /* Pre-allocate enough capacity for compatibility with old config_load()
    * that assumes static arrays. */
-  if (ensure_library_capacity(&state, 100) != 0 ||
+  if (ensure_library_capacity(&state, 100, 0) != 0 ||
       ensure_playlists_capacity(&state, 20) != 0) {
     fprintf(stderr, "Out of memory.\n");
     player_shutdown();
@@ -159,11 +553,17 @@ int main(int argc, char *argv[]) {
   /* Load config (volume, library, playlists, last track) */
   config_load(&state);
 
-  initscr();
+  library_set_current(&state, state.current_track);
+
+  /* Reopens the device only if config.json asks for other settings. */
+  if (player_set_audio(&state.audio) != 0)
+    config_audio_defaults(&state.audio);
+
   noecho();
   cbreak();
   keypad(stdscr, TRUE);
-  timeout(100);
+  /* The event loop knows when input is ready; getch() never waits. */
+  timeout(0);
 
   if (state.current_volume < 0 || state.current_volume > 100)
     state.current_volume = 100;
@@ -172,117 +572,270 @@ int main(int argc, char *argv[]) {
   strncpy(state.message, "Welcome to lmp!", sizeof(state.message) - 1);
 
   while (state.is_running) {
+    /* Sampled before the polls below so that no result can be missed. */
+    int tick = background_busy() ? BACKGROUND_TICK_MS : 0;
+    int save_in;
+
+    if (player_get_status() == PLAYER_PLAYING)
+      tick = PROGRESS_TICK_MS;
+
+    addfolder_poll(&state);
+    webdownload_poll(&state);
+    library_probe_poll(&state);
+    save_in = config_tick(&state);
     draw_ui(&state);
-    ch = getch();
-
-    if (ch != ERR) {
-      switch (ch) {
-      case 'q':
-        state.is_running = 0;
-        break;
-      case ':':
-        getmaxyx(stdscr, rows, cols);
-        echo();
-        strncpy(state.command_buffer, "", sizeof(state.command_buffer) - 1);
-
-        attron(A_REVERSE);
-        mvprintw(rows - 1, 0, ":");
-        for (int i = 1; i < cols; i++)
-          printw(" ");
-        move(rows - 1, 1);
-        attroff(A_REVERSE);
-
-        timeout(-1);
-        getstr(state.command_buffer);
-        timeout(100);
-
-        noecho();
-        clear();
-        refresh();
-
-        handle_command(&state);
-        break;
-      }
-    }
 
-    if (state.current_track[0] != '\0' && !player_is_playing()) {
-      if (strcmp(state.mode, "repeat-one") == 0) {
-        play_track(&state, state.current_track);
-        snprintf(state.message, sizeof(state.message), "Repeating track.");
-      } else if (strcmp(state.mode, "shuffle") == 0) {
-        if (state.track_count > 0) {
-          int next_track_index = rand() % state.track_count;
-          play_track(&state, state.library[next_track_index].path);
-          snprintf(state.message, sizeof(state.message),
-                   "Shuffling to next track.");
-        }
-      } else if (state.playing_playlist_index != -1) {
-        Playlist *pl = &state.playlists[state.playing_playlist_index];
-
-        if (!pl->track_indices || pl->track_count <= 0) {
-          state.playing_playlist_index = -1;
-          state.current_track[0] = '\0';
-          state.track_duration = 0.0;
-          snprintf(state.message, sizeof(state.message),
-                   "Playlist finished or invalid.");
-          continue;
-        }
-
-        if (strcmp(state.mode, "repeat-all") == 0 &&
-            state.playing_track_index_in_playlist >= pl->track_count - 1) {
-          state.playing_track_index_in_playlist = 0;
-        } else {
-          state.playing_track_index_in_playlist++;
-        }
-
-        if (state.playing_track_index_in_playlist < pl->track_count) {
-          int lib_idx =
-              pl->track_indices[state.playing_track_index_in_playlist];
-          if (lib_idx >= 0 && lib_idx < state.track_count) {
-            play_track(&state, state.library[lib_idx].path);
-            snprintf(state.message, sizeof(state.message),
-                     "Now playing next track in '%s'", pl->name);
-          } else {
-            state.playing_playlist_index = -1;
-            state.current_track[0] = '\0';
-            state.track_duration = 0.0;
-            snprintf(state.message, sizeof(state.message),
-                     "Playlist '%s' finished (invalid index).", pl->name);
-          }
-        } else {
-          state.playing_playlist_index = -1;
-          state.current_track[0] = '\0';
-          state.track_duration = 0.0;
-          snprintf(state.message, sizeof(state.message),
-                   "Playlist '%s' finished.", pl->name);
-        }
-      } else {
-        state.current_track[0] = '\0';
-        state.track_duration = 0.0;
-        snprintf(state.message, sizeof(state.message), "Playback Finished.");
-      }
+    /* 0 is a signal: SIGWINCH turns into KEY_RESIZE in getch(). */
+    ev = events_wait(tick, save_in);
+    if (ev == 0 || (ev & EV_INPUT)) {
+      while (state.is_running && (ch = getch()) != ERR)
+        handle_key(&state, ch);
     }
+
+    if (player_take_switch())
+      next_track_started(&state);
+
+    if (state.current_track[0] != '\0' && !player_is_playing())
+      advance_track(&state);
+    else if (state.current_track[0] != '\0' && !g_next.queued &&
+             near_track_end(&state))
+      queue_next_track(&state);
   }
 
-  /* Persist on exit */
+  /* An unfinished addfolder is dropped, not merged */
+  scanner_shutdown();
+  jobs_shutdown();
+  probe_shutdown();
+
+  /* Persist on exit; folds the journal into config.json */
+  config_shutdown();
   config_save(&state);
+  journal_close();
 
   endwin();
   free_app_state(&state);
   player_shutdown();
+  events_shutdown();
   return 0;
 }
 
-void draw_ui(AppState *state) {
+/*
+ * Screen regions as last drawn.  draw_ui() only rewrites the ones whose
+ * text changed, without clear(), so an idle screen costs no output and a
+ * ticking progress bar costs a few bytes.  ui_invalidate() forces a full
+ * redraw, e.g. after a command view took over the screen.
+ */
+#define UI_LINE_MAX 512
+
+struct ui_line {
+  int y, x;
+  char text[UI_LINE_MAX];
+};
+
+static struct {
+  int valid;
   int rows, cols;
-  char display_buffer[256];
+  struct ui_line status;
+  struct ui_line mode;
+  struct ui_line underruns;
+  char message[sizeof(((AppState *)0)->message)];
+  int bar_drawn;
+  int bar_y, bar_w, prog_w;
+  char bar_time[64];
+} g_ui;
+
+/*
+ * Terminal output of draw_ui(), for checking what redraws cost.  ncurses
+ * write()s straight to the terminal, so this is the difference in the
+ * thread's write counter around refresh().  Linux only; stays 0 elsewhere.
+ */
+static unsigned long long g_tty_bytes;
+static int g_io_fd = -1;
+
+static long long thread_wchar(void) {
+  char buf[512], *p;
+  ssize_t n;
+
+  if (g_io_fd < 0)
+    return -1;
+  n = pread(g_io_fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0)
+    return -1;
+  buf[n] = '\0';
+  p = strstr(buf, "wchar:");
+  return p ? strtoll(p + 6, NULL, 10) : -1;
+}
+
+static void ui_init(void) {
+  initscr();
+  /* Esc closes the search pane; do not wait a second for more of it. */
+  set_escdelay(25);
+  g_io_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+}
+
+unsigned long long ui_bytes_written(void) { return g_tty_bytes; }
+
+void ui_invalidate(void) { g_ui.valid = 0; }
+
+/* Blank what the line showed before and write the new text. */
+static int ui_put(struct ui_line *l, int y, int x, const char *text) {
+  if (g_ui.valid && l->y == y && l->x == x && strcmp(l->text, text) == 0)
+    return 0;
+
+  if (g_ui.valid && l->text[0])
+    mvprintw(l->y, l->x, "%*s", (int)strlen(l->text), "");
+  if (text[0])
+    mvprintw(y, x, "%s", text);
+
+  l->y = y;
+  l->x = x;
+  strncpy(l->text, text, sizeof(l->text) - 1);
+  l->text[sizeof(l->text) - 1] = '\0';
+  return 1;
+}
+
+static int ui_message(const char *message) {
+  if (g_ui.valid && strcmp(g_ui.message, message) == 0)
+    return 0;
+
+  /* Messages can span lines (help); wipe the rows between header and bar. */
+  if (g_ui.valid) {
+    for (int y = 2; y < g_ui.rows - 3; y++) {
+      move(y, 0);
+      clrtoeol();
+    }
+  }
+  mvprintw(2, 2, "Message: %s", message);
+
+  strncpy(g_ui.message, message, sizeof(g_ui.message) - 1);
+  g_ui.message[sizeof(g_ui.message) - 1] = '\0';
+  return 1;
+}
+
+/*
+ * The search pane takes the message area.  Only the rows that fit are
+ * drawn, so a keystroke costs the same with ten matches or a million.
+ */
+static int ui_filter(AppState *state) {
+  int first = 4, last = g_ui.rows - 5, count, width, i;
+
+  filter_sync(state);
+  if (g_ui.valid && !g_filter.dirty)
+    return 0;
+
+  for (int y = 2; y < g_ui.rows - 3; y++) {
+    move(y, 0);
+    clrtoeol();
+  }
+
+  count = filter_count();
+  mvprintw(2, 2, "Search: %s", g_filter.query);
+  printw("   (%d of %d)", count, state->track_count);
+
+  if (last < first)
+    last = first;
+  if (g_filter.selected < g_filter.top)
+    g_filter.top = g_filter.selected;
+  if (g_filter.selected > g_filter.top + (last - first))
+    g_filter.top = g_filter.selected - (last - first);
+
+  width = g_ui.cols - 16 > 1 ? g_ui.cols - 16 : 1;
+  for (i = 0; i <= last - first && g_filter.top + i < count; i++) {
+    int slot = filter_slot(g_filter.top + i);
+
+    if (g_filter.top + i == g_filter.selected)
+      attron(A_REVERSE);
+    mvprintw(first + i, 4, "%d: %.*s", slot + 1, width,
+             library_name(state, slot));
+    if (g_filter.top + i == g_filter.selected)
+      attroff(A_REVERSE);
+  }
+
+  g_filter.dirty = 0;
+  return 1;
+}
+
+static int ui_progress(AppState *state) {
+  char time_str[64];
+  double pos, dur;
+  int bar_w, prog_w, y = g_ui.rows - 3;
+
+  if (!player_is_playing() || state->track_duration <= 0) {
+    if (!g_ui.bar_drawn)
+      return 0;
+    move(g_ui.bar_y, 0);
+    clrtoeol();
+    g_ui.bar_drawn = 0;
+    return 1;
+  }
+
+  pos = player_get_current_position();
+  dur = state->track_duration;
+  if (pos > dur)
+    pos = dur;
+
+  sprintf(time_str, "%02d:%02d / %02d:%02d", (int)pos / 60, (int)pos % 60,
+          (int)dur / 60, (int)dur % 60);
+
+  bar_w = g_ui.cols - 5 - (int)strlen(time_str);
+  if (bar_w < 10)
+    bar_w = 10;
+
+  prog_w = dur > 0.0 ? (int)((pos / dur) * bar_w) : 0;
+  if (prog_w > bar_w)
+    prog_w = bar_w;
+
+  if (g_ui.valid && g_ui.bar_drawn && g_ui.bar_y == y &&
+      g_ui.bar_w == bar_w && g_ui.prog_w == prog_w &&
+      strcmp(g_ui.bar_time, time_str) == 0)
+    return 0;
+
+  mvprintw(y, 0, "  [");
+  attron(A_REVERSE);
+  for (int i = 0; i < prog_w; i++)
+    printw(" ");
+  attroff(A_REVERSE);
+  for (int i = prog_w; i < bar_w; i++)
+    printw("-");
+  printw("] %s", time_str);
+
+  g_ui.bar_drawn = 1;
+  g_ui.bar_y = y;
+  g_ui.bar_w = bar_w;
+  g_ui.prog_w = prog_w;
+  strcpy(g_ui.bar_time, time_str);
+  return 1;
+}
+
+void draw_ui(AppState *state) {
+  int rows, cols, changed = 0;
+  char status_line[256] = "";
+  char mode_line[64];
+  char underruns[64] = "";
   const char *status_text = NULL;
   PlayerStatus status = player_get_status();
 
-  clear();
   getmaxyx(stdscr, rows, cols);
+  if (rows != g_ui.rows || cols != g_ui.cols)
+    g_ui.valid = 0;
 
-  mvprintw(0, 2, "L-M-P Player");
+  if (!g_ui.valid) {
+    erase();
+    memset(&g_ui, 0, sizeof(g_ui));
+    g_ui.rows = rows;
+    g_ui.cols = cols;
+
+    mvprintw(0, 2, "L-M-P Player");
+    attron(A_REVERSE);
+    if (g_filter.active)
+      mvprintw(rows - 1, 0,
+               "Type to filter, Up/Down to choose, Enter plays, Esc closes");
+    else
+      mvprintw(rows - 1, 0,
+               "Press ':' for commands, '/' to search, 'q' to quit");
+    attroff(A_REVERSE);
+    changed = 1;
+  }
 
   switch (status) {
   case PLAYER_PLAYING:
@@ -298,77 +851,50 @@ void draw_ui(AppState *state) {
   }
 
   if (status_text && state->current_track[0] != '\0') {
-    char temp_buffer[256] = {0};
-    const char *track_display_name = NULL;
-    int i;
-
-    for (i = 0; i < state->track_count; i++) {
-      if (strcmp(state->library[i].path, state->current_track) == 0) {
-        track_display_name = state->library[i].name;
-        break;
-      }
-    }
-
-    if (!track_display_name) {
-      const char *filename = strrchr(state->current_track, '/');
-      if (filename)
-        track_display_name = filename + 1;
-      else
-        track_display_name = state->current_track;
-    }
+    char display_buffer[256];
+    const char *track_display_name = library_current_name(state);
 
     if (state->playing_playlist_index != -1) {
-      sprintf(temp_buffer, "Playlist: %s | ",
-              state->playlists[state->playing_playlist_index].name);
+      snprintf(status_line, sizeof(status_line), "Playlist: %s | ",
+               state->playlists[state->playing_playlist_index].name);
     }
 
-    sprintf(display_buffer, "%s - \"%s\" | Volume: %d", status_text,
-            track_display_name, state->current_volume);
-    strncat(temp_buffer, display_buffer,
-            sizeof(temp_buffer) - strlen(temp_buffer) - 1);
+    snprintf(display_buffer, sizeof(display_buffer),
+             "%s - \"%s\" | Volume: %d", status_text, track_display_name,
+             state->current_volume);
+    strncat(status_line, display_buffer,
+            sizeof(status_line) - strlen(status_line) - 1);
 
-    if ((int)strlen(temp_buffer) + 2 < cols)
-      mvprintw(0, cols - (int)strlen(temp_buffer) - 2, "%s", temp_buffer);
+    if ((int)strlen(status_line) + 2 >= cols)
+      status_line[0] = '\0';
   }
-  mvprintw(1, cols - (int)strlen(state->mode) - 8, "Mode: %s", state->mode);
-
-  mvprintw(2, 2, "Message: %s", state->message);
-
-  if (player_is_playing() && state->track_duration > 0) {
-    double pos = player_get_current_position();
-    double dur = state->track_duration;
-    char time_str[64];
-    int bar_w, prog_w;
-
-    if (pos > dur)
-      pos = dur;
-
-    sprintf(time_str, "%02d:%02d / %02d:%02d", (int)pos / 60, (int)pos % 60,
-            (int)dur / 60, (int)dur % 60);
-
-    bar_w = cols - 5 - (int)strlen(time_str);
-    if (bar_w < 10)
-      bar_w = 10;
+  changed |= ui_put(&g_ui.status, 0,
+                    status_line[0] ? cols - (int)strlen(status_line) - 2 : 0,
+                    status_line);
+
+  snprintf(mode_line, sizeof(mode_line), "Mode: %s", state->mode);
+  changed |= ui_put(&g_ui.mode, 1, cols - (int)strlen(mode_line) - 2,
+                    mode_line);
+  if (player_underruns())
+    snprintf(underruns, sizeof(underruns), "Underruns: %lu",
+             player_underruns());
+  changed |= ui_put(&g_ui.underruns, 1, 2, underruns);
+
+  if (g_filter.active)
+    changed |= ui_filter(state);
+  else
+    changed |= ui_message(state->message);
+  changed |= ui_progress(state);
 
-    prog_w = dur > 0.0 ? (int)((pos / dur) * bar_w) : 0;
-    if (prog_w > bar_w)
-      prog_w = bar_w;
+  g_ui.valid = 1;
+  if (changed) {
+    long long before = thread_wchar(), after;
 
-    mvprintw(rows - 3, 0, "  [");
-    attron(A_REVERSE);
-    for (int i = 0; i < prog_w; i++)
-      printw(" ");
-    attroff(A_REVERSE);
-    for (int i = prog_w; i < bar_w; i++)
-      printw("-");
-    printw("] %s", time_str);
+    refresh();
+    after = thread_wchar();
+    if (before >= 0 && after > before)
+      g_tty_bytes += (unsigned long long)(after - before);
   }
-
-  attron(A_REVERSE);
-  mvprintw(rows - 1, 0, "Press ':' for commands, 'q' to quit");
-  attroff(A_REVERSE);
-
-  refresh();
 }
 
 static void handle_command(AppState *state) {
@@ -390,13 +916,18 @@ static void handle_command(AppState *state) {
 
   if (strcmp(command, "add") == 0) {                   cmd_add(state, argument);
   } else if (strcmp(command, "addfolder") == 0) {      cmd_addfolder(state, argument);
+  } else if (strcmp(command, "cancel") == 0) {         cmd_cancel(state);
   } else if (strcmp(command, "webdownload") == 0) {    cmd_webdownload(state, argument);
+  } else if (strcmp(command, "jobs") == 0) {           cmd_jobs(state);
   } else if (strcmp(command, "help") == 0) {           cmd_help(state, argument);
   } else if (strcmp(command, "rename") == 0) {         cmd_rename(state, argument);
   } else if (strcmp(command, "play") == 0) {           cmd_play(state, argument);
   } else if (strcmp(command, "pause") == 0) {          cmd_pause(state);
   } else if (strcmp(command, "volume") == 0) {         cmd_volume(state, argument);
   } else if (strcmp(command, "setvolume") == 0) {      cmd_setvolume(state, argument);
+  } else if (strcmp(command, "audio") == 0) {          cmd_audio(state);
+  } else if (strcmp(command, "uistats") == 0) {        cmd_uistats(state);
+  } else if (strcmp(command, "setaudio") == 0) {       cmd_setaudio(state, argument);
   } else if (strcmp(command, "author") == 0) {         cmd_show_authors(state);
   } else if (strcmp(command, "setmode") == 0) {        cmd_setmode(state, argument);
   } else if (strcmp(command, "mode") == 0) {           cmd_mode(state);
@@ -406,6 +937,9 @@ static void handle_command(AppState *state) {
   } else if (strcmp(command, "listview") == 0) {       cmd_listview(state, argument);
   } else if (strcmp(command, "listplay") == 0) {       cmd_listplay(state, argument);
   } else if (strcmp(command, "stop") == 0) {           cmd_stop(state);
+  } else if (strcmp(command, "seek") == 0) {           cmd_seek(state, argument);
+  } else if (strcmp(command, "ff") == 0) {             cmd_skip_time(state, argument, 1);
+  } else if (strcmp(command, "rew") == 0) {            cmd_skip_time(state, argument, -1);
   } else if (strcmp(command, "search") == 0) {         cmd_search(state, argument);
   } else if (strcmp(command, "next") == 0) {           cmd_next(state);
   } else if (strcmp(command, "skip") == 0) {           cmd_skip(state);
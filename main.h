@@ -1,13 +1,72 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include <limits.h>
+#include <stdint.h>
 
-
+/*
+ * Track names and paths live in AppState.strings (library_strings.c); a
+ * Track only holds offsets into it.  Read them with library_name() and
+ * library_path().
+ */
 typedef struct Track {
-	char	name[50];
-	char	path[256];
+	uint64_t id;		/* stable across renames and removals */
+	uint32_t name;		/* arena offset of the name */
+	uint32_t dir;		/* interned directory of the path, or TRACK_NO_DIR */
+	uint32_t file;		/* arena offset of the path after that directory */
+	uint32_t key;		/* arena offset of the folded name (fold.h), or name */
+
+	/* Cached by the background probe, checked against the file */
+	double	duration;	/* seconds; 0 unknown, -1 unreadable */
+	int64_t	size;		/* size and mtime the duration was read at */
+	int64_t	mtime;
 } Track;
 
+#define TRACK_NO_DIR	UINT32_MAX
+
+/* Packed, NUL-terminated Track strings and the directories they share */
+typedef struct TrackStrings {
+	char	 *arena;
+	uint32_t  len;
+	uint32_t  cap;
+	uint32_t  garbage;	/* bytes no Track refers to any more */
+	uint32_t *dirs;		/* arena offset of each interned directory */
+	uint32_t  dir_count;
+	uint32_t  dir_cap;
+	uint32_t *dir_slots;	/* hash of dirs: dirs index + 1, 0 empty */
+	uint32_t  dir_slots_cap;	/* power of two */
+} TrackStrings;
+
+/* Open-addressing multimap from a Track key to library slots */
+typedef struct TrackIndex {
+	int	*slots;		/* library index + 1; 0 empty, -1 deleted */
+	int	 cap;		/* power of two */
+	int	 used;		/* live and deleted slots */
+} TrackIndex;
+
+/* Gram -> track ID postings over folded names (search_index.c) */
+typedef struct SearchIndex {
+	struct gram_list *lists;
+	uint32_t	  list_count;
+	uint32_t	  list_cap;
+	uint32_t	 *slots;	/* hash of lists: index + 1, 0 empty */
+	uint32_t	  slot_cap;	/* power of two */
+	int		  built;	/* else searches scan the library */
+} SearchIndex;
+
+enum {
+	AUDIO_FORMAT_S16,
+	AUDIO_FORMAT_F32,
+};
+
+/* Audio device settings (config.json, setaudio) */
+typedef struct AudioConfig {
+	int	rate;		/* Hz */
+	int	buffer;		/* sample frames per device period */
+	int	format;		/* AUDIO_FORMAT_* */
+	int	native_rate;	/* reopen the device at each MP3's own rate */
+} AudioConfig;
+
 typedef struct Playlist {
 	char	name[50];
 	int	*track_indices;
@@ -19,6 +78,12 @@ typedef struct AppState {
 	Track	 *library;
 	int	 library_cap;
 	int	 track_count;
+	TrackStrings strings;
+	TrackIndex name_index;
+	TrackIndex path_index;
+	TrackIndex id_index;
+	SearchIndex search_index;
+	uint64_t next_track_id;
 
 	Playlist *playlists;
 	int	 playlists_cap;
@@ -27,7 +92,11 @@ typedef struct AppState {
 	char     mode[50];
 	int	 is_running;
 	int	 current_volume;
-	char	 current_track[256];
+	int	 save_delay_ms;
+	int	 binary_snapshot;
+	AudioConfig audio;
+	char	 current_track[PATH_MAX];
+	int	 current_track_index;	/* its library slot, or -1 */
 	char	 command_buffer[256];
 	char	 message[2048];
 	double	 track_duration;
@@ -36,6 +105,10 @@ typedef struct AppState {
 } AppState;
 
 void draw_ui(AppState *state);
+void ui_invalidate(void);
+unsigned long long ui_bytes_written(void);
 void play_track(AppState *state, const char *track_path);
+void play_library_track(AppState *state, int idx);
+void search_filter_open(AppState *state);
 
 #endif /* MAIN_H */
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mp3info.h"
+
+/* Need this many consecutive frames to call a headerless file CBR. */
+#define CBR_MIN_FRAMES		8
+#define ID3V1_SIZE		128
+
+struct frame_hdr {
+	int	lsf;		/* MPEG-2 or 2.5 (low sampling frequency) */
+	int	layer;		/* 1..3 */
+	int	bitrate;	/* kbit/s */
+	int	rate;		/* Hz */
+	int	mono;
+	int	spf;		/* samples per frame */
+	int	len;		/* bytes, header included */
+};
+
+/* [lsf][layer - 1][index] in kbit/s; 0 is "free format", unsupported. */
+static const short bitrates[2][3][15] = {
+	{
+		{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+		{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+	},
+	{
+		{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+	},
+};
+
+/* [version bits][index]; version 1 is reserved. */
+static const int sample_rates[4][3] = {
+	{ 11025, 12000, 8000 },		/* MPEG-2.5 */
+	{ 0, 0, 0 },
+	{ 22050, 24000, 16000 },	/* MPEG-2 */
+	{ 44100, 48000, 32000 },	/* MPEG-1 */
+};
+
+static uint32_t be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static int parse_header(const unsigned char *p, struct frame_hdr *h)
+{
+	int version, layer, br, sr, pad;
+
+	if (p[0] != 0xff || (p[1] & 0xe0) != 0xe0)
+		return -1;
+
+	version = (p[1] >> 3) & 3;
+	layer = 4 - ((p[1] >> 1) & 3);
+	br = p[2] >> 4;
+	sr = (p[2] >> 2) & 3;
+	pad = (p[2] >> 1) & 1;
+
+	if (version == 1 || layer == 4 || br == 0 || br == 15 || sr == 3)
+		return -1;
+
+	h->lsf = version != 3;
+	h->layer = layer;
+	h->bitrate = bitrates[h->lsf][layer - 1][br];
+	h->rate = sample_rates[version][sr];
+	h->mono = (p[3] >> 6) == 3;
+
+	if (layer == 1) {
+		h->spf = 384;
+		h->len = (12000 * h->bitrate / h->rate + pad) * 4;
+	} else if (layer == 2 || !h->lsf) {
+		h->spf = 1152;
+		h->len = 144000 * h->bitrate / h->rate + pad;
+	} else {
+		h->spf = 576;
+		h->len = 72000 * h->bitrate / h->rate + pad;
+	}
+	return 0;
+}
+
+static int same_stream(const struct frame_hdr *a, const struct frame_hdr *b)
+{
+	return a->lsf == b->lsf && a->layer == b->layer && a->rate == b->rate;
+}
+
+/*
+ * First offset that holds a frame header followed by another one of the
+ * same stream, so a stray 0xff in leftover tag data is not taken for sync.
+ */
+static long find_sync(const unsigned char *buf, size_t len,
+		      struct frame_hdr *h)
+{
+	struct frame_hdr next;
+	size_t i;
+
+	for (i = 0; i + 4 <= len; i++) {
+		if (parse_header(buf + i, h) != 0)
+			continue;
+		if (i + h->len + 4 > len)
+			return (long)i;
+		if (parse_header(buf + i + h->len, &next) == 0 &&
+		    same_stream(h, &next))
+			return (long)i;
+	}
+	return -1;
+}
+
+/* Encoder delay + padding from a LAME tag at p, or 0. */
+static long lame_gapless(const unsigned char *p, const unsigned char *end)
+{
+	if (end - p < 24)
+		return 0;
+	if (memcmp(p, "LAME", 4) != 0 && memcmp(p, "Lavf", 4) != 0 &&
+	    memcmp(p, "Lavc", 4) != 0)
+		return 0;
+
+	p += 21;
+	return (long)((p[0] << 4) | (p[1] >> 4)) +
+	       (long)(((p[1] & 0x0f) << 8) | p[2]);
+}
+
+/*
+ * Total frame count from a Xing/Info or VBRI header in the first frame,
+ * and the samples the encoder added around the audio.
+ * Return: 0 if there is no usable header.
+ */
+static long vbr_header_frames(const unsigned char *frame,
+			      const unsigned char *end,
+			      const struct frame_hdr *h, long *gapless)
+{
+	const unsigned char *p;
+	uint32_t flags;
+	long frames;
+
+	*gapless = 0;
+	if (h->layer != 3)
+		return 0;
+
+	/* Xing/Info sits right after the side information. */
+	p = frame + 4 + (h->lsf ? (h->mono ? 9 : 17) : (h->mono ? 17 : 32));
+	if (end - p >= 12 &&
+	    (memcmp(p, "Xing", 4) == 0 || memcmp(p, "Info", 4) == 0)) {
+		flags = be32(p + 4);
+		if (!(flags & 1))
+			return 0;
+		frames = (long)be32(p + 8);
+
+		p += 12;
+		if (flags & 2)
+			p += 4;
+		if (flags & 4)
+			p += 100;
+		if (flags & 8)
+			p += 4;
+		if (p < end)
+			*gapless = lame_gapless(p, end);
+		return frames;
+	}
+
+	/* VBRI (Fraunhofer) is always 32 bytes after the header. */
+	p = frame + 36;
+	if (end - p >= 18 && memcmp(p, "VBRI", 4) == 0)
+		return (long)be32(p + 14);
+	return 0;
+}
+
+/*
+ * Walk the frames in buf from the first one; if they all have the same
+ * bitrate the file is taken to be CBR.  Return: the bitrate, or 0.
+ */
+static int cbr_bitrate(const unsigned char *buf, size_t len,
+		       const struct frame_hdr *first)
+{
+	struct frame_hdr h;
+	size_t off = 0;
+	int frames = 0;
+
+	while (off + 4 <= len) {
+		if (parse_header(buf + off, &h) != 0 || !same_stream(first, &h))
+			break;
+		if (h.bitrate != first->bitrate)
+			return 0;
+		frames++;
+		off += (size_t)h.len;
+	}
+
+	/* Either the buffer ended mid-frame, or so did the file. */
+	if (frames < CBR_MIN_FRAMES && off + 4 <= len)
+		return 0;
+	return frames ? first->bitrate : 0;
+}
+
+/* Offset of the audio after any ID3v2 tags at the start of fd. */
+static off_t skip_id3v2(int fd)
+{
+	unsigned char hdr[10];
+	off_t off = 0;
+	uint32_t size;
+
+	while (pread(fd, hdr, sizeof(hdr), off) == (ssize_t)sizeof(hdr) &&
+	       memcmp(hdr, "ID3", 3) == 0) {
+		if ((hdr[6] | hdr[7] | hdr[8] | hdr[9]) & 0x80)
+			break;
+		size = (uint32_t)hdr[6] << 21 | (uint32_t)hdr[7] << 14 |
+		       (uint32_t)hdr[8] << 7 | hdr[9];
+		off += 10 + (off_t)size + ((hdr[5] & 0x10) ? 10 : 0);
+	}
+	return off;
+}
+
+static int has_id3v1(int fd, off_t size)
+{
+	char tag[3];
+
+	return size >= ID3V1_SIZE &&
+	       pread(fd, tag, sizeof(tag), size - ID3V1_SIZE) == 3 &&
+	       memcmp(tag, "TAG", 3) == 0;
+}
+
+/**
+ * mp3_header_duration() - duration without decoding the whole file.
+ *
+ * Return: seconds, or -1 if the headers do not tell (headerless VBR, not
+ * an MP3, unreadable) and the caller has to scan the file.
+ */
+double mp3_header_duration(const char *filename)
+{
+	unsigned char *buf = NULL;
+	struct frame_hdr h;
+	struct stat st;
+	double duration = -1.0;
+	off_t start, audio;
+	ssize_t n;
+	long sync, frames, gapless, samples;
+	int fd, bitrate;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1.0;
+	if (fstat(fd, &st) != 0)
+		goto out;
+
+	start = skip_id3v2(fd);
+	buf = malloc(MP3INFO_READ_SIZE);
+	if (!buf)
+		goto out;
+	n = pread(fd, buf, MP3INFO_READ_SIZE, start);
+	if (n < 4)
+		goto out;
+
+	sync = find_sync(buf, (size_t)n, &h);
+	if (sync < 0)
+		goto out;
+
+	frames = vbr_header_frames(buf + sync, buf + n, &h, &gapless);
+	if (frames > 0) {
+		samples = frames * h.spf - gapless;
+		if (samples > 0)
+			duration = (double)samples / h.rate;
+		goto out;
+	}
+
+	bitrate = cbr_bitrate(buf + sync, (size_t)(n - sync), &h);
+	if (bitrate > 0) {
+		audio = st.st_size - start - sync;
+		if (has_id3v1(fd, st.st_size))
+			audio -= ID3V1_SIZE;
+		if (audio > 0)
+			duration = (double)audio * 8.0 / (bitrate * 1000.0);
+	}
+out:
+	free(buf);
+	close(fd);
+	return duration;
+}
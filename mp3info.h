@@ -0,0 +1,18 @@
+#ifndef MP3INFO_H
+#define MP3INFO_H
+
+/*
+ * MP3 duration from the headers at the start of the file.
+ *
+ * Reads at most the ID3v2 tag header and the first MP3INFO_READ_SIZE bytes
+ * of audio: a Xing/Info or VBRI header gives the exact frame count (minus
+ * the LAME encoder delay and padding when present), and a file whose
+ * frames all share one bitrate is CBR, so its length follows from the file
+ * size.  Anything else, i.e. VBR without a header, needs a full scan.
+ */
+
+#define MP3INFO_READ_SIZE	(64 * 1024)
+
+double mp3_header_duration(const char *filename);
+
+#endif /* MP3INFO_H */
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "probe.h"
+#include "functions.h"
+
+struct probe_req {
+	struct probe_req *next;
+	uint64_t	  id;
+	int64_t		  size;
+	int64_t		  mtime;
+	int		  index;	/* build a seek index, no result */
+	char		  path[];
+};
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t g_thread;
+static int g_started;
+static int g_stop;
+
+/* FIFO, except that urgent requests jump to the front. */
+static struct probe_req *g_head, *g_tail;
+static size_t g_pending;		/* queued or being probed */
+
+static struct probe_result *g_results;
+static size_t g_nresults, g_results_cap;
+
+static void push_result(const struct probe_req *req, double duration,
+			int64_t size, int64_t mtime)
+{
+	struct probe_result *tmp, *r;
+	size_t cap;
+	char *path;
+
+	path = strdup(req->path);
+	if (!path)
+		return;
+
+	pthread_mutex_lock(&g_lock);
+	if (g_nresults == g_results_cap) {
+		cap = g_results_cap ? g_results_cap * 2 : 64;
+		tmp = realloc(g_results, cap * sizeof(*g_results));
+		if (!tmp) {
+			pthread_mutex_unlock(&g_lock);
+			free(path);
+			return;
+		}
+		g_results = tmp;
+		g_results_cap = cap;
+	}
+	r = &g_results[g_nresults++];
+	r->id = req->id;
+	r->path = path;
+	r->duration = duration;
+	r->size = size;
+	r->mtime = mtime;
+	pthread_mutex_unlock(&g_lock);
+}
+
+static void probe_one(const struct probe_req *req)
+{
+	struct stat st;
+	double duration;
+
+	if (stat(req->path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		push_result(req, -1.0, 0, 0);
+		return;
+	}
+
+	/* Cache still valid: nothing to report. */
+	if ((int64_t)st.st_size == req->size &&
+	    (int64_t)st.st_mtime == req->mtime)
+		return;
+
+	duration = get_mp3_duration(req->path);
+	push_result(req, duration > 0 ? duration : -1.0,
+		    (int64_t)st.st_size, (int64_t)st.st_mtime);
+}
+
+static void *probe_main(void *arg)
+{
+	struct probe_req *req;
+
+	(void)arg;
+
+	pthread_mutex_lock(&g_lock);
+	for (;;) {
+		while (!g_head && !g_stop)
+			pthread_cond_wait(&g_cond, &g_lock);
+		if (g_stop)
+			break;
+
+		req = g_head;
+		g_head = req->next;
+		if (!g_head)
+			g_tail = NULL;
+		pthread_mutex_unlock(&g_lock);
+
+		if (req->index)
+			seek_index_build(req->path);
+		else
+			probe_one(req);
+		free(req);
+
+		pthread_mutex_lock(&g_lock);
+		g_pending--;
+	}
+	pthread_mutex_unlock(&g_lock);
+	return NULL;
+}
+
+static struct probe_req *new_req(const char *path)
+{
+	struct probe_req *req;
+	size_t len;
+
+	len = strlen(path) + 1;
+	req = calloc(1, sizeof(*req) + len);
+	if (req)
+		memcpy(req->path, path, len);
+	return req;
+}
+
+/* Start the worker if need be and queue req; frees it on failure. */
+static int queue_req(struct probe_req *req, int urgent)
+{
+	pthread_mutex_lock(&g_lock);
+	if (!g_started) {
+		if (pthread_create(&g_thread, NULL, probe_main, NULL) != 0) {
+			pthread_mutex_unlock(&g_lock);
+			free(req);
+			return -1;
+		}
+		g_started = 1;
+	}
+
+	if (urgent) {
+		req->next = g_head;
+		g_head = req;
+		if (!g_tail)
+			g_tail = req;
+	} else {
+		if (g_tail)
+			g_tail->next = req;
+		else
+			g_head = req;
+		g_tail = req;
+	}
+	g_pending++;
+	pthread_cond_signal(&g_cond);
+	pthread_mutex_unlock(&g_lock);
+	return 0;
+}
+
+/**
+ * probe_submit() - queue a track for probing.
+ * @size, @mtime: what the cached duration was read from (0 if none).
+ * @urgent:       put it ahead of everything else (the track about to play).
+ *
+ * Return: 0 if queued, -1 on allocation or thread creation failure.
+ */
+int probe_submit(uint64_t id, const char *path, int64_t size, int64_t mtime,
+		 int urgent)
+{
+	struct probe_req *req;
+
+	if (!path)
+		return -1;
+
+	req = new_req(path);
+	if (!req)
+		return -1;
+	req->id = id;
+	req->size = size;
+	req->mtime = mtime;
+	return queue_req(req, urgent);
+}
+
+/**
+ * probe_submit_index() - have the seek index of @path built, ahead of
+ * everything else; see seek_index_build().
+ *
+ * Return: 0 if queued, -1 on allocation or thread creation failure.
+ */
+int probe_submit_index(const char *path)
+{
+	struct probe_req *req;
+
+	if (!path)
+		return -1;
+
+	req = new_req(path);
+	if (!req)
+		return -1;
+	req->index = 1;
+	return queue_req(req, 1);
+}
+
+/* Requests the worker has not finished yet. */
+size_t probe_pending(void)
+{
+	size_t n;
+
+	pthread_mutex_lock(&g_lock);
+	n = g_pending;
+	pthread_mutex_unlock(&g_lock);
+	return n;
+}
+
+/*
+ * Take every result produced so far; free them with probe_free_results().
+ * Return: NULL with *count 0 if there are none.
+ */
+struct probe_result *probe_take(size_t *count)
+{
+	struct probe_result *res;
+
+	pthread_mutex_lock(&g_lock);
+	res = g_results;
+	*count = g_nresults;
+	g_results = NULL;
+	g_nresults = g_results_cap = 0;
+	pthread_mutex_unlock(&g_lock);
+	return res;
+}
+
+void probe_free_results(struct probe_result *res, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		free(res[i].path);
+	free(res);
+}
+
+/* Stop the worker after the file it is on and drop everything queued. */
+void probe_shutdown(void)
+{
+	struct probe_req *req;
+	struct probe_result *res;
+	size_t n;
+
+	pthread_mutex_lock(&g_lock);
+	g_stop = 1;
+	pthread_cond_signal(&g_cond);
+	pthread_mutex_unlock(&g_lock);
+
+	if (g_started)
+		pthread_join(g_thread, NULL);
+	g_started = 0;
+
+	while ((req = g_head) != NULL) {
+		g_head = req->next;
+		free(req);
+	}
+	g_tail = NULL;
+	g_pending = 0;
+
+	res = probe_take(&n);
+	probe_free_results(res, n);
+	g_stop = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Background duration probe.
+ *
+ * A single worker thread takes (track, path) requests, stats the file and
+ * only runs get_mp3_duration() on it when its size or mtime differ from
+ * the cached ones sent along with the request.  Results are picked up by
+ * the UI thread with probe_take(); the worker never touches AppState.
+ * It also builds the seek index of the track being played
+ * (probe_submit_index()), which reads the whole file as well.
+ */
+
+struct probe_result {
+	uint64_t	 id;		/* Track.id the request was made for, or 0 */
+	char		*path;		/* malloc'd */
+	double		 duration;	/* seconds, -1 if the file is unreadable */
+	int64_t		 size;
+	int64_t		 mtime;
+};
+
+int probe_submit(uint64_t id, const char *path, int64_t size, int64_t mtime,
+		 int urgent);
+int probe_submit_index(const char *path);
+size_t probe_pending(void);
+struct probe_result *probe_take(size_t *count);
+void probe_free_results(struct probe_result *res, size_t count);
+void probe_shutdown(void);
+
+#endif /* PROBE_H */
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "scanner.h"
+
+#define SCAN_MAX_THREADS	8
+
+/*
+ * Pending directories form a LIFO stack shared by the workers, so the walk
+ * is roughly depth-first and the stack stays small on wide trees.  Each
+ * worker reads a whole directory without holding the lock and publishes
+ * its subdirectories and matches in one go when it is done with it.
+ */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t g_threads[SCAN_MAX_THREADS];
+static int g_nthreads;
+static int g_live;		/* workers that have not exited yet */
+static int g_busy;		/* workers currently reading a directory */
+static int g_active;		/* a scan was started and not collected */
+static atomic_int g_cancel;
+static int (*g_match)(const char *name);
+
+static char **g_dirs;
+static size_t g_ndirs, g_dirs_cap;
+
+static struct scan_file *g_files;
+static size_t g_nfiles, g_files_cap;
+
+static unsigned long g_dirs_done;
+static unsigned long g_errors;
+
+struct dir_batch {
+	char		**dirs;
+	size_t		  ndirs, dirs_cap;
+	struct scan_file *files;
+	size_t		  nfiles, files_cap;
+	unsigned long	  errors;
+};
+
+static int grow(void **arr, size_t *cap, size_t need, size_t elem)
+{
+	size_t newcap = *cap ? *cap : 64;
+	void *tmp;
+
+	if (need <= *cap)
+		return 0;
+	while (newcap < need) {
+		if (newcap > SIZE_MAX / 2 / elem)
+			return -1;
+		newcap *= 2;
+	}
+	tmp = realloc(*arr, newcap * elem);
+	if (!tmp)
+		return -1;
+	*arr = tmp;
+	*cap = newcap;
+	return 0;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+	size_t dlen = strlen(dir), nlen = strlen(name);
+	char *p;
+
+	while (dlen > 1 && dir[dlen - 1] == '/')
+		dlen--;
+
+	p = malloc(dlen + nlen + 2);
+	if (!p)
+		return NULL;
+	memcpy(p, dir, dlen);
+	p[dlen] = '/';
+	memcpy(p + dlen + 1, name, nlen + 1);
+	return p;
+}
+
+static void batch_dir(struct dir_batch *b, const char *dir, const char *name)
+{
+	char *p;
+
+	if (grow((void **)&b->dirs, &b->dirs_cap, b->ndirs + 1,
+		 sizeof(*b->dirs)) != 0 || !(p = join_path(dir, name))) {
+		b->errors++;
+		return;
+	}
+	b->dirs[b->ndirs++] = p;
+}
+
+static void batch_file(struct dir_batch *b, const char *dir, const char *name)
+{
+	struct scan_file *f;
+	char *p;
+
+	if (grow((void **)&b->files, &b->files_cap, b->nfiles + 1,
+		 sizeof(*b->files)) != 0 || !(p = join_path(dir, name))) {
+		b->errors++;
+		return;
+	}
+	f = &b->files[b->nfiles++];
+	f->path = p;
+	f->name_off = strlen(p) - strlen(name);
+}
+
+/* Hand a finished directory's findings over to the shared lists. */
+static void batch_publish(struct dir_batch *b)
+{
+	size_t i;
+
+	pthread_mutex_lock(&g_lock);
+
+	if (b->ndirs &&
+	    grow((void **)&g_dirs, &g_dirs_cap, g_ndirs + b->ndirs,
+		 sizeof(*g_dirs)) != 0) {
+		for (i = 0; i < b->ndirs; i++)
+			free(b->dirs[i]);
+		b->errors += b->ndirs;
+		b->ndirs = 0;
+	}
+	/* Push in reverse so the first subdirectory is scanned first. */
+	for (i = b->ndirs; i > 0; i--)
+		g_dirs[g_ndirs++] = b->dirs[i - 1];
+	if (b->ndirs)
+		pthread_cond_broadcast(&g_cond);
+
+	if (b->nfiles &&
+	    grow((void **)&g_files, &g_files_cap, g_nfiles + b->nfiles,
+		 sizeof(*g_files)) != 0) {
+		for (i = 0; i < b->nfiles; i++)
+			free(b->files[i].path);
+		b->errors += b->nfiles;
+		b->nfiles = 0;
+	}
+	if (b->nfiles) {
+		memcpy(g_files + g_nfiles, b->files,
+		       b->nfiles * sizeof(*b->files));
+		g_nfiles += b->nfiles;
+	}
+
+	g_errors += b->errors;
+	pthread_mutex_unlock(&g_lock);
+
+	free(b->dirs);
+	free(b->files);
+}
+
+/*
+ * d_type answers "directory or regular file?" for free on most
+ * filesystems; fstatat() relative to the open directory is only needed
+ * when it is DT_UNKNOWN, or to see what a symlink to a candidate file
+ * points at.  Symlinked directories are not followed, so the walk cannot
+ * loop.
+ */
+static void scan_dir(const char *path)
+{
+	struct dir_batch b;
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+	int fd, type;
+
+	memset(&b, 0, sizeof(b));
+
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0 || !(d = fdopendir(fd))) {
+		if (fd >= 0)
+			close(fd);
+		b.errors++;
+		batch_publish(&b);
+		return;
+	}
+
+	while (!atomic_load_explicit(&g_cancel, memory_order_relaxed) &&
+	       (de = readdir(d)) != NULL) {
+		const char *name = de->d_name;
+
+		if (name[0] == '.' &&
+		    (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		type = de->d_type;
+		if (type == DT_UNKNOWN) {
+			if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+				b.errors++;
+				continue;
+			}
+			if (S_ISDIR(st.st_mode))
+				type = DT_DIR;
+			else if (S_ISREG(st.st_mode))
+				type = DT_REG;
+			else if (S_ISLNK(st.st_mode))
+				type = DT_LNK;
+		}
+
+		if (type == DT_DIR) {
+			batch_dir(&b, path, name);
+			continue;
+		}
+		if ((type != DT_REG && type != DT_LNK) || !g_match(name))
+			continue;
+		if (type == DT_LNK &&
+		    (fstatat(fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))) {
+			b.errors++;
+			continue;
+		}
+		batch_file(&b, path, name);
+	}
+	closedir(d);
+	batch_publish(&b);
+}
+
+static void *scan_worker(void *arg)
+{
+	char *dir;
+
+	(void)arg;
+
+	pthread_mutex_lock(&g_lock);
+	for (;;) {
+		while (g_ndirs == 0 && g_busy > 0 && !atomic_load(&g_cancel))
+			pthread_cond_wait(&g_cond, &g_lock);
+		if (g_ndirs == 0 || atomic_load(&g_cancel))
+			break;
+
+		dir = g_dirs[--g_ndirs];
+		g_busy++;
+		pthread_mutex_unlock(&g_lock);
+
+		scan_dir(dir);
+		free(dir);
+
+		pthread_mutex_lock(&g_lock);
+		g_busy--;
+		g_dirs_done++;
+		if (g_busy == 0 && g_ndirs == 0)
+			pthread_cond_broadcast(&g_cond);
+	}
+	g_live--;
+	pthread_cond_broadcast(&g_cond);
+	pthread_mutex_unlock(&g_lock);
+	return NULL;
+}
+
+static int scan_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* Mostly waiting on the disk, so a few more threads than CPUs. */
+	if (n < 1)
+		n = 1;
+	n *= 2;
+	if (n > SCAN_MAX_THREADS)
+		n = SCAN_MAX_THREADS;
+	return (int)n;
+}
+
+/* Drop everything left over from the last scan.  Workers must be joined. */
+static void scan_reset(void)
+{
+	size_t i;
+
+	for (i = 0; i < g_ndirs; i++)
+		free(g_dirs[i]);
+	free(g_dirs);
+	g_dirs = NULL;
+	g_ndirs = g_dirs_cap = 0;
+
+	scanner_free_files(g_files, g_nfiles);
+	g_files = NULL;
+	g_nfiles = g_files_cap = 0;
+
+	g_nthreads = g_live = g_busy = 0;
+	g_dirs_done = g_errors = 0;
+	g_active = 0;
+	atomic_store(&g_cancel, 0);
+}
+
+static void scan_join(void)
+{
+	int i;
+
+	for (i = 0; i < g_nthreads; i++)
+		pthread_join(g_threads[i], NULL);
+	g_nthreads = 0;
+}
+
+/**
+ * scanner_start() - start walking root in the background.
+ *
+ * Return: 0 if the scan was started, -1 if one is already running or no
+ * worker thread could be created.
+ */
+int scanner_start(const char *root, int (*match)(const char *name))
+{
+	char *dir;
+	int i, n;
+
+	if (!root || !match || g_active)
+		return -1;
+
+	dir = strdup(root);
+	if (!dir || grow((void **)&g_dirs, &g_dirs_cap, 1, sizeof(*g_dirs))) {
+		free(dir);
+		return -1;
+	}
+
+	pthread_mutex_lock(&g_lock);
+	g_dirs[g_ndirs++] = dir;
+	g_match = match;
+	g_active = 1;
+
+	n = scan_threads();
+	for (i = 0; i < n; i++) {
+		if (pthread_create(&g_threads[g_nthreads], NULL,
+				   scan_worker, NULL) != 0)
+			break;
+		g_nthreads++;
+		g_live++;
+	}
+	pthread_mutex_unlock(&g_lock);
+
+	if (g_nthreads == 0) {
+		scan_reset();
+		return -1;
+	}
+	return 0;
+}
+
+/* Return: 1 and fill *st while a scan is running or uncollected, else 0. */
+int scanner_status(struct scan_status *st)
+{
+	if (!g_active)
+		return 0;
+
+	pthread_mutex_lock(&g_lock);
+	st->dirs = g_dirs_done;
+	st->files = g_nfiles;
+	st->errors = g_errors;
+	st->done = g_live == 0;
+	st->cancelled = atomic_load(&g_cancel);
+	pthread_mutex_unlock(&g_lock);
+	return 1;
+}
+
+static int cmp_path(const void *a, const void *b)
+{
+	return strcmp(((const struct scan_file *)a)->path,
+		      ((const struct scan_file *)b)->path);
+}
+
+/**
+ * scanner_collect() - take the result of a finished scan.
+ *
+ * The files come back sorted by path, whatever order the workers found
+ * them in.  The caller owns them and releases them with
+ * scanner_free_files().  The scanner is idle again afterwards.
+ *
+ * Return: the files (NULL if none), or NULL with *count 0 while the scan
+ * is still running.
+ */
+struct scan_file *scanner_collect(size_t *count)
+{
+	struct scan_file *files;
+	struct scan_status st;
+
+	*count = 0;
+	if (!scanner_status(&st) || !st.done)
+		return NULL;
+
+	scan_join();
+	files = g_files;
+	*count = g_nfiles;
+	g_files = NULL;
+	g_nfiles = 0;
+	scan_reset();
+
+	if (*count > 1)
+		qsort(files, *count, sizeof(*files), cmp_path);
+	return files;
+}
+
+void scanner_free_files(struct scan_file *files, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		free(files[i].path);
+	free(files);
+}
+
+/* Ask the workers to stop; scanner_status() reports done once they have. */
+void scanner_cancel(void)
+{
+	if (!g_active)
+		return;
+
+	pthread_mutex_lock(&g_lock);
+	atomic_store(&g_cancel, 1);
+	pthread_cond_broadcast(&g_cond);
+	pthread_mutex_unlock(&g_lock);
+}
+
+/* Stop any running scan and throw its result away. */
+void scanner_shutdown(void)
+{
+	if (!g_active)
+		return;
+
+	scanner_cancel();
+	scan_join();
+	scan_reset();
+}
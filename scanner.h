@@ -0,0 +1,38 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stddef.h>
+
+/*
+ * Recursive directory scanner used by addfolder.
+ *
+ * scanner_start() walks a directory tree on a small pool of worker threads
+ * and collects every regular file whose name passes the match callback.
+ * Nothing in AppState is touched from the workers: the UI thread polls
+ * scanner_status() and, once the walk is done, takes the sorted result
+ * with scanner_collect() and merges it into the library itself.
+ *
+ * Only one scan runs at a time.
+ */
+
+struct scan_file {
+	char	*path;		/* malloc'd, full path */
+	size_t	 name_off;	/* offset of the file name within path */
+};
+
+struct scan_status {
+	unsigned long	dirs;		/* directories read so far */
+	unsigned long	files;		/* matching files found so far */
+	unsigned long	errors;		/* directories or entries that failed */
+	int		done;		/* all workers have finished */
+	int		cancelled;
+};
+
+int scanner_start(const char *root, int (*match)(const char *name));
+int scanner_status(struct scan_status *st);
+struct scan_file *scanner_collect(size_t *count);
+void scanner_free_files(struct scan_file *files, size_t count);
+void scanner_cancel(void);
+void scanner_shutdown(void);
+
+#endif /* SCANNER_H */
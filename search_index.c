@@ -0,0 +1,423 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "search_index.h"
+#include "library_index.h"
+#include "library_strings.h"
+#include "fold.h"
+
+#define LISTS_MIN_CAP		256
+#define GRAM_SLOTS_MIN_CAP	512
+#define IDS_MIN_CAP		4
+
+struct gram_list {
+	uint32_t	 gram;
+	uint32_t	 count;
+	uint32_t	 cap;
+	uint64_t	*ids;		/* ascending */
+};
+
+/* s is a search key, so already folded. */
+static uint32_t gram_at(const char *s)
+{
+	return (uint32_t)(unsigned char)s[0] << 16 |
+	       (uint32_t)(unsigned char)s[1] << 8 |
+	       (unsigned char)s[2];
+}
+
+static uint32_t hash_gram(uint32_t gram)
+{
+	gram *= 0x9e3779b1u;
+	return gram ^ (gram >> 16);
+}
+
+/* The query's key in a malloc'd string, or NULL if out of memory. */
+static char *fold_query(const char *query)
+{
+	char *key = malloc(strlen(query) + 1);
+
+	if (key)
+		fold_key(query, key);
+	return key;
+}
+
+static struct gram_list *gram_find(const SearchIndex *ix, uint32_t gram)
+{
+	uint32_t mask, i, v;
+
+	if (!ix->slots)
+		return NULL;
+
+	mask = ix->slot_cap - 1;
+	for (i = hash_gram(gram) & mask; (v = ix->slots[i]) != 0;
+	     i = (i + 1) & mask) {
+		if (ix->lists[v - 1].gram == gram)
+			return &ix->lists[v - 1];
+	}
+	return NULL;
+}
+
+static void slot_put(uint32_t *slots, uint32_t cap, uint32_t gram,
+		     uint32_t list)
+{
+	uint32_t mask = cap - 1;
+	uint32_t i = hash_gram(gram) & mask;
+
+	while (slots[i])
+		i = (i + 1) & mask;
+	slots[i] = list + 1;
+}
+
+static int slots_grow(SearchIndex *ix)
+{
+	uint32_t cap = ix->slot_cap ? ix->slot_cap * 2 : GRAM_SLOTS_MIN_CAP;
+	uint32_t *slots, i;
+
+	slots = calloc(cap, sizeof(*slots));
+	if (!slots)
+		return -1;
+	for (i = 0; i < ix->list_count; i++)
+		slot_put(slots, cap, ix->lists[i].gram, i);
+
+	free(ix->slots);
+	ix->slots = slots;
+	ix->slot_cap = cap;
+	return 0;
+}
+
+/* The list for gram, created empty if there is none yet. */
+static struct gram_list *gram_get(SearchIndex *ix, uint32_t gram)
+{
+	struct gram_list *l = gram_find(ix, gram), *tmp;
+	uint32_t cap;
+
+	if (l)
+		return l;
+
+	/* Grams are 24 bits, so neither of these can overflow. */
+	if (ix->list_count == ix->list_cap) {
+		cap = ix->list_cap ? ix->list_cap * 2 : LISTS_MIN_CAP;
+		tmp = realloc(ix->lists, (size_t)cap * sizeof(*tmp));
+		if (!tmp)
+			return NULL;
+		ix->lists = tmp;
+		ix->list_cap = cap;
+	}
+	if ((ix->list_count + 1) * 2 > ix->slot_cap && slots_grow(ix) != 0)
+		return NULL;
+
+	l = &ix->lists[ix->list_count];
+	memset(l, 0, sizeof(*l));
+	l->gram = gram;
+	slot_put(ix->slots, ix->slot_cap, gram, ix->list_count++);
+	return l;
+}
+
+/* First position at or after lo whose ID is not below id. */
+static uint32_t list_lower(const struct gram_list *l, uint32_t lo, uint64_t id)
+{
+	uint32_t hi = l->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (l->ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int list_insert(struct gram_list *l, uint64_t id)
+{
+	uint64_t *tmp;
+	uint32_t pos, cap;
+
+	/* New tracks get the highest ID, so this is nearly always an append. */
+	pos = l->count && l->ids[l->count - 1] >= id ? list_lower(l, 0, id)
+						      : l->count;
+	if (pos < l->count && l->ids[pos] == id)
+		return 0;
+
+	if (l->count == l->cap) {
+		if (l->cap > UINT32_MAX / 2)
+			return -1;
+		cap = l->cap ? l->cap * 2 : IDS_MIN_CAP;
+		tmp = realloc(l->ids, (size_t)cap * sizeof(*tmp));
+		if (!tmp)
+			return -1;
+		l->ids = tmp;
+		l->cap = cap;
+	}
+
+	memmove(l->ids + pos + 1, l->ids + pos,
+		(size_t)(l->count - pos) * sizeof(*l->ids));
+	l->ids[pos] = id;
+	l->count++;
+	return 0;
+}
+
+static void list_erase(struct gram_list *l, uint64_t id)
+{
+	uint32_t pos = list_lower(l, 0, id);
+
+	if (pos == l->count || l->ids[pos] != id)
+		return;
+	memmove(l->ids + pos, l->ids + pos + 1,
+		(size_t)(l->count - pos - 1) * sizeof(*l->ids));
+	l->count--;
+}
+
+static int index_track(SearchIndex *ix, const char *key, uint64_t id)
+{
+	struct gram_list *l;
+	size_t i, n = strlen(key);
+
+	for (i = 0; i + SEARCH_GRAM <= n; i++) {
+		l = gram_get(ix, gram_at(key + i));
+		if (!l || list_insert(l, id) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int index_build(AppState *state)
+{
+	SearchIndex *ix = &state->search_index;
+	int i;
+
+	search_index_free(state);
+	for (i = 0; i < state->track_count; i++) {
+		if (index_track(ix, library_key(state, i),
+				state->library[i].id) != 0) {
+			search_index_free(state);
+			return -1;
+		}
+	}
+	ix->built = 1;
+	return 0;
+}
+
+/* idx must already be stored in state->library. */
+void search_index_add(AppState *state, int idx)
+{
+	SearchIndex *ix = &state->search_index;
+
+	if (!ix->built)
+		return;
+	if (index_track(ix, library_key(state, idx),
+			state->library[idx].id) != 0)
+		search_index_free(state);
+}
+
+/* Call while idx still holds the track's current name. */
+void search_index_remove(AppState *state, int idx)
+{
+	SearchIndex *ix = &state->search_index;
+	const char *key = library_key(state, idx);
+	struct gram_list *l;
+	size_t i, n;
+
+	if (!ix->built)
+		return;
+
+	n = strlen(key);
+	for (i = 0; i + SEARCH_GRAM <= n; i++) {
+		l = gram_find(ix, gram_at(key + i));
+		if (l)
+			list_erase(l, state->library[idx].id);
+	}
+}
+
+void search_index_free(AppState *state)
+{
+	SearchIndex *ix = &state->search_index;
+	uint32_t i;
+
+	for (i = 0; i < ix->list_count; i++)
+		free(ix->lists[i].ids);
+	free(ix->lists);
+	free(ix->slots);
+	memset(ix, 0, sizeof(*ix));
+}
+
+static int cmp_count(const void *a, const void *b)
+{
+	const struct gram_list *x = *(const struct gram_list *const *)a;
+	const struct gram_list *y = *(const struct gram_list *const *)b;
+
+	return x->count < y->count ? -1 : x->count > y->count;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Keep the IDs in cand[0..n) that l also has.  Return: how many. */
+static uint32_t intersect(uint64_t *cand, uint32_t n,
+			  const struct gram_list *l)
+{
+	uint32_t i, k = 0, pos = 0;
+
+	for (i = 0; i < n; i++) {
+		pos = list_lower(l, pos, cand[i]);
+		if (pos == l->count)
+			break;
+		if (l->ids[pos] == cand[i])
+			cand[k++] = cand[i];
+	}
+	return k;
+}
+
+/* The slots whose keys contain key, found through the index. */
+static int search_indexed(AppState *state, const char *key, int **slots)
+{
+	SearchIndex *ix = &state->search_index;
+	const struct gram_list **lists;
+	size_t klen = strlen(key), nl, i;
+	uint64_t *cand;
+	uint32_t nc;
+	int *out, n = 0, idx;
+
+	nl = klen - SEARCH_GRAM + 1;
+	lists = malloc(nl * sizeof(*lists));
+	if (!lists)
+		return -1;
+	for (i = 0; i < nl; i++) {
+		lists[i] = gram_find(ix, gram_at(key + i));
+		if (!lists[i] || lists[i]->count == 0) {
+			free(lists);
+			return 0;
+		}
+	}
+
+	/* Start from the shortest list; the candidates only shrink. */
+	qsort(lists, nl, sizeof(*lists), cmp_count);
+	nc = lists[0]->count;
+	cand = malloc((size_t)nc * sizeof(*cand));
+	if (!cand) {
+		free(lists);
+		return -1;
+	}
+	memcpy(cand, lists[0]->ids, (size_t)nc * sizeof(*cand));
+	for (i = 1; i < nl && nc; i++)
+		nc = intersect(cand, nc, lists[i]);
+	free(lists);
+
+	out = nc ? malloc((size_t)nc * sizeof(*out)) : NULL;
+	if (nc && !out) {
+		free(cand);
+		return -1;
+	}
+
+	/* Having every gram does not mean having them in a row. */
+	for (i = 0; i < nc; i++) {
+		idx = library_find_by_id(state, cand[i]);
+		if (idx >= 0 && strstr(library_key(state, idx), key))
+			out[n++] = idx;
+	}
+	free(cand);
+
+	if (n == 0) {
+		free(out);
+		return 0;
+	}
+	qsort(out, (size_t)n, sizeof(*out), cmp_int);
+	*slots = out;
+	return n;
+}
+
+/* The slots in set[0..count) whose keys contain key, in the same order. */
+static int filter_keys(const AppState *state, const char *key,
+		       const int *set, int count, int **slots)
+{
+	int *out, n = 0, i, idx;
+
+	if (count <= 0)
+		return 0;
+
+	out = malloc((size_t)count * sizeof(*out));
+	if (!out)
+		return -1;
+	for (i = 0; i < count; i++) {
+		idx = set ? set[i] : i;
+		if (idx < state->track_count &&
+		    strstr(library_key(state, idx), key))
+			out[n++] = idx;
+	}
+
+	if (n == 0) {
+		free(out);
+		return 0;
+	}
+	*slots = out;
+	return n;
+}
+
+/**
+ * library_search() - library slots whose names contain @query.
+ *
+ * Matching compares search keys (fold.h), so it ignores case and accents.
+ * The slots come back in library order in a malloc'd array for the caller
+ * to free (NULL if there are none).
+ *
+ * Return: the number of matches, or -1 if out of memory.
+ */
+int library_search(AppState *state, const char *query, int **slots)
+{
+	char *key = fold_query(query);
+	int n;
+
+	*slots = NULL;
+	if (!key)
+		return -1;
+	if (strlen(key) < SEARCH_GRAM ||
+	    (!state->search_index.built && index_build(state) != 0))
+		n = filter_keys(state, key, NULL, state->track_count, slots);
+	else
+		n = search_indexed(state, key, slots);
+	free(key);
+	return n;
+}
+
+/* The same result as library_search(), from a pass over every name. */
+int library_search_scan(const AppState *state, const char *query,
+			int **slots)
+{
+	char *key = fold_query(query);
+	int n;
+
+	*slots = NULL;
+	if (!key)
+		return -1;
+	n = filter_keys(state, key, NULL, state->track_count, slots);
+	free(key);
+	return n;
+}
+
+/**
+ * library_search_refine() - narrow down an earlier result.
+ * @slots, @count: the matches for a query that @query contains, such as
+ *                 the one typed before its last character.
+ *
+ * Only those slots can match, so this costs nothing like a new search.
+ *
+ * Return: as library_search().
+ */
+int library_search_refine(const AppState *state, const char *query,
+			  const int *slots, int count, int **out)
+{
+	char *key = fold_query(query);
+	int n;
+
+	*out = NULL;
+	if (!key)
+		return -1;
+	n = filter_keys(state, key, slots, count, out);
+	free(key);
+	return n;
+}
@@ -0,0 +1,34 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include "main.h"
+
+/*
+ * Substring search over track names, ignoring case and accents.
+ *
+ * Every name's search key (fold.h) is cut into overlapping three-byte
+ * grams, and each gram keeps the ascending IDs of the tracks whose keys
+ * contain it.  A query of three bytes or more only looks at the tracks in the
+ * intersection of its grams' lists, and checks those for the whole query.
+ * Shorter queries, or any search while the index cannot be allocated,
+ * scan the library instead.
+ *
+ * The first search builds the index; from then on the library mutation
+ * helpers in functions.c keep it up to date.  Code that replaces the
+ * library wholesale (the loaders) calls search_index_free() and the next
+ * search builds it again.
+ */
+
+#define SEARCH_GRAM	3
+
+int library_search(AppState *state, const char *query, int **slots);
+int library_search_scan(const AppState *state, const char *query,
+			int **slots);
+int library_search_refine(const AppState *state, const char *query,
+			  const int *slots, int count, int **out);
+
+void search_index_add(AppState *state, int idx);
+void search_index_remove(AppState *state, int idx);
+void search_index_free(AppState *state);
+
+#endif /* SEARCH_INDEX_H */
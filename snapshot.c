@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "snapshot.h"
+#include "config.h"
+#include "functions.h"
+#include "library_index.h"
+#include "library_strings.h"
+#include "search_index.h"
+
+#define SNAPSHOT_MAGIC		"LMPB"
+#define SNAPSHOT_VERSION	4
+#define SNAPSHOT_NO_STRING	UINT32_MAX
+#define SNAPSHOT_PATH_MAX	512
+
+struct snap_header {
+	char		magic[4];
+	uint32_t	version;
+	uint64_t	json_size;
+	int64_t		json_mtime_sec;
+	int64_t		json_mtime_nsec;
+	uint64_t	journal_seq;
+	uint64_t	next_track_id;
+	int32_t		volume;
+	int32_t		save_delay_ms;
+	int32_t		audio_rate;
+	int32_t		audio_buffer;
+	int32_t		audio_format;
+	int32_t		audio_native_rate;
+	uint32_t	last_track;	/* strtab offset or SNAPSHOT_NO_STRING */
+	uint32_t	track_count;
+	uint32_t	playlist_count;
+	uint32_t	index_count;
+	uint32_t	strtab_size;
+	uint32_t	reserved;
+	uint64_t	tracks_off;
+	uint64_t	playlists_off;
+	uint64_t	index_off;
+	uint64_t	strtab_off;
+};
+
+struct snap_track {
+	uint64_t	id;
+	double		duration;
+	int64_t		size;
+	int64_t		mtime;
+	uint32_t	name;
+	uint32_t	path;
+};
+
+struct snap_playlist {
+	uint32_t	name;
+	uint32_t	first;		/* into the index array */
+	uint32_t	count;
+	uint32_t	reserved;
+};
+
+static size_t align8(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+struct strtab {
+	char	*base;
+	size_t	 len;
+};
+
+static uint32_t strtab_put(struct strtab *st, const char *s)
+{
+	size_t n = strlen(s) + 1;
+	uint32_t off = (uint32_t)st->len;
+
+	memcpy(st->base + st->len, s, n);
+	st->len += n;
+	return off;
+}
+
+/* Track paths are kept split up; join them straight into the table. */
+static uint32_t strtab_put_path(struct strtab *st, const AppState *state,
+				int idx)
+{
+	size_t n = library_path(state, idx, NULL, 0) + 1;
+	uint32_t off = (uint32_t)st->len;
+
+	library_path(state, idx, st->base + st->len, n);
+	st->len += n;
+	return off;
+}
+
+/**
+ * snapshot_build() - serialize state into a library.bin image.
+ *
+ * The json_* fields stay zero until snapshot_stamp() is called with the
+ * config.json the image was published alongside.
+ */
+void *snapshot_build(const AppState *state, unsigned long seq, size_t *len)
+{
+	struct snap_header *h;
+	struct snap_track *tr;
+	struct snap_playlist *pl;
+	uint32_t *index;
+	struct strtab st;
+	size_t strings = 1, entries = 0, total;
+	char *image;
+	int i, j, n;
+
+	if (!state || !len)
+		return NULL;
+
+	strings += strlen(state->current_track) + 1;
+	for (i = 0; i < state->track_count; i++)
+		strings += strlen(library_name(state, i)) +
+			   library_path(state, i, NULL, 0) + 2;
+	for (i = 0; i < state->playlist_count; i++) {
+		strings += strlen(state->playlists[i].name) + 1;
+		entries += (size_t)state->playlists[i].track_count;
+	}
+	if (strings > UINT32_MAX || entries > UINT32_MAX)
+		return NULL;
+
+	total = align8(sizeof(*h));
+	total += align8((size_t)state->track_count * sizeof(*tr));
+	total += align8((size_t)state->playlist_count * sizeof(*pl));
+	total += align8(entries * sizeof(*index));
+	total += align8(strings);
+
+	image = calloc(1, total);
+	if (!image)
+		return NULL;
+
+	h = (struct snap_header *)image;
+	memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+	h->version = SNAPSHOT_VERSION;
+	h->journal_seq = seq;
+	h->next_track_id = state->next_track_id;
+	h->volume = state->current_volume;
+	h->save_delay_ms = state->save_delay_ms;
+	h->audio_rate = state->audio.rate;
+	h->audio_buffer = state->audio.buffer;
+	h->audio_format = state->audio.format;
+	h->audio_native_rate = state->audio.native_rate;
+	h->track_count = (uint32_t)state->track_count;
+	h->playlist_count = (uint32_t)state->playlist_count;
+	h->tracks_off = align8(sizeof(*h));
+	h->playlists_off = h->tracks_off +
+			   align8((size_t)state->track_count * sizeof(*tr));
+	h->index_off = h->playlists_off +
+		       align8((size_t)state->playlist_count * sizeof(*pl));
+	h->strtab_off = h->index_off + align8(entries * sizeof(*index));
+
+	tr = (struct snap_track *)(image + h->tracks_off);
+	pl = (struct snap_playlist *)(image + h->playlists_off);
+	index = (uint32_t *)(image + h->index_off);
+	st.base = image + h->strtab_off;
+	st.len = 0;
+
+	/* Offset 0 is always the empty string. */
+	strtab_put(&st, "");
+
+	h->last_track = state->current_track[0] ?
+			strtab_put(&st, state->current_track) :
+			SNAPSHOT_NO_STRING;
+
+	for (i = 0; i < state->track_count; i++) {
+		tr[i].id = state->library[i].id;
+		tr[i].duration = state->library[i].duration;
+		tr[i].size = state->library[i].size;
+		tr[i].mtime = state->library[i].mtime;
+		tr[i].name = strtab_put(&st, library_name(state, i));
+		tr[i].path = strtab_put_path(&st, state, i);
+	}
+
+	n = 0;
+	for (i = 0; i < state->playlist_count; i++) {
+		const Playlist *p = &state->playlists[i];
+
+		pl[i].name = strtab_put(&st, p->name);
+		pl[i].first = (uint32_t)n;
+		for (j = 0; j < p->track_count; j++)
+			index[n++] = (uint32_t)p->track_indices[j];
+		pl[i].count = (uint32_t)(n - pl[i].first);
+	}
+
+	h->index_count = (uint32_t)n;
+	h->strtab_size = (uint32_t)st.len;
+	*len = total;
+	return image;
+}
+
+void snapshot_stamp(void *image, const struct stat *json_st)
+{
+	struct snap_header *h = image;
+
+	h->json_size = (uint64_t)json_st->st_size;
+	h->json_mtime_sec = (int64_t)json_st->st_mtim.tv_sec;
+	h->json_mtime_nsec = (int64_t)json_st->st_mtim.tv_nsec;
+}
+
+static int region_ok(uint64_t off, uint64_t count, size_t elem, size_t size)
+{
+	if (off > size || (off & 7))
+		return 0;
+	return count <= (size - off) / elem;
+}
+
+/* Check every offset in the mapped image before anything is copied out. */
+static int validate(const char *base, size_t size, const struct stat *json_st)
+{
+	const struct snap_header *h = (const struct snap_header *)base;
+	const struct snap_track *tr;
+	const struct snap_playlist *pl;
+	const char *strtab;
+	uint32_t i;
+
+	if (size < sizeof(*h))
+		return -1;
+	if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 ||
+	    h->version != SNAPSHOT_VERSION)
+		return -1;
+
+	/* Stale: config.json was rewritten without us (or edited by hand). */
+	if (h->json_size != (uint64_t)json_st->st_size ||
+	    h->json_mtime_sec != (int64_t)json_st->st_mtim.tv_sec ||
+	    h->json_mtime_nsec != (int64_t)json_st->st_mtim.tv_nsec)
+		return -1;
+
+	if (h->track_count > INT32_MAX || h->playlist_count > INT32_MAX)
+		return -1;
+	if (!region_ok(h->tracks_off, h->track_count, sizeof(*tr), size) ||
+	    !region_ok(h->playlists_off, h->playlist_count, sizeof(*pl), size) ||
+	    !region_ok(h->index_off, h->index_count, sizeof(uint32_t), size) ||
+	    !region_ok(h->strtab_off, h->strtab_size, 1, size))
+		return -1;
+
+	strtab = base + h->strtab_off;
+	if (h->strtab_size == 0 || strtab[h->strtab_size - 1] != '\0')
+		return -1;
+	if (h->last_track != SNAPSHOT_NO_STRING &&
+	    h->last_track >= h->strtab_size)
+		return -1;
+
+	tr = (const struct snap_track *)(base + h->tracks_off);
+	for (i = 0; i < h->track_count; i++) {
+		if (tr[i].name >= h->strtab_size || tr[i].path >= h->strtab_size)
+			return -1;
+	}
+
+	pl = (const struct snap_playlist *)(base + h->playlists_off);
+	for (i = 0; i < h->playlist_count; i++) {
+		if (pl[i].name >= h->strtab_size ||
+		    pl[i].first > h->index_count ||
+		    pl[i].count > h->index_count - pl[i].first)
+			return -1;
+	}
+	return 0;
+}
+
+static void copy_str(char *dst, size_t size, const char *src)
+{
+	strncpy(dst, src, size - 1);
+	dst[size - 1] = '\0';
+}
+
+static int load_image(AppState *state, const char *base)
+{
+	const struct snap_header *h = (const struct snap_header *)base;
+	const struct snap_track *tr;
+	const struct snap_playlist *pl;
+	const uint32_t *index;
+	const char *strtab;
+	AudioConfig audio;
+	Playlist *p;
+	uint64_t next_id;
+	uint32_t i, j;
+
+	tr = (const struct snap_track *)(base + h->tracks_off);
+	pl = (const struct snap_playlist *)(base + h->playlists_off);
+	index = (const uint32_t *)(base + h->index_off);
+	strtab = base + h->strtab_off;
+
+	state->track_count = 0;
+	state->playlist_count = 0;
+	track_strings_free(&state->strings);
+	search_index_free(state);
+
+	/* Shared directories make the names and paths take less than this. */
+	if (ensure_library_capacity(state, (int)h->track_count,
+				    h->strtab_size) != 0 ||
+	    ensure_playlists_capacity(state, (int)h->playlist_count) != 0)
+		return -1;
+
+	next_id = h->next_track_id ? h->next_track_id : 1;
+	for (i = 0; i < h->track_count; i++) {
+		Track *t = &state->library[i];
+
+		if (track_strings_add(&state->strings, t, strtab + tr[i].name,
+				      strtab + tr[i].path) != 0)
+			return -1;
+		t->id = tr[i].id;
+		t->duration = tr[i].duration;
+		t->size = tr[i].size;
+		t->mtime = tr[i].mtime;
+		if (t->id >= next_id)
+			next_id = t->id + 1;
+	}
+	state->track_count = (int)h->track_count;
+	state->next_track_id = next_id;
+	library_index_rebuild(state);
+
+	for (i = 0; i < h->playlist_count; i++) {
+		p = &state->playlists[i];
+		p->track_count = 0;
+		if (ensure_playlist_tracks_capacity(p, (int)pl[i].count) != 0)
+			return -1;
+
+		copy_str(p->name, sizeof(p->name), strtab + pl[i].name);
+		for (j = 0; j < pl[i].count; j++) {
+			uint32_t t = index[pl[i].first + j];
+
+			if (t < h->track_count)
+				p->track_indices[p->track_count++] = (int)t;
+		}
+		state->playlist_count++;
+	}
+
+	if (h->volume >= 0 && h->volume <= 100)
+		state->current_volume = h->volume;
+	if (h->save_delay_ms >= 0)
+		state->save_delay_ms = h->save_delay_ms;
+	audio.rate = h->audio_rate;
+	audio.buffer = h->audio_buffer;
+	audio.format = h->audio_format;
+	audio.native_rate = h->audio_native_rate != 0;
+	if (config_audio_valid(&audio))
+		state->audio = audio;
+	if (h->last_track != SNAPSHOT_NO_STRING)
+		copy_str(state->current_track, sizeof(state->current_track),
+			 strtab + h->last_track);
+	return 0;
+}
+
+/**
+ * snapshot_load() - load state from library.bin if it matches config.json.
+ *
+ * Return: 0 on success with *seq set to the journal seq the snapshot covers,
+ * -1 if the file is missing, stale or damaged (state is left untouched in
+ * the first two cases).
+ */
+int snapshot_load(AppState *state, const struct stat *json_st,
+		  unsigned long *seq)
+{
+	char path[SNAPSHOT_PATH_MAX];
+	struct stat st;
+	void *map;
+	int fd, ret = -1;
+
+	if (!state || !json_st || !seq)
+		return -1;
+
+	config_file_path(path, sizeof(path), SNAPSHOT_FILE);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct snap_header)) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	if (validate(map, (size_t)st.st_size, json_st) == 0 &&
+	    load_image(state, map) == 0) {
+		*seq = ((const struct snap_header *)map)->journal_seq;
+		ret = 0;
+	}
+
+	munmap(map, (size_t)st.st_size);
+	return ret;
+}
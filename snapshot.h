@@ -0,0 +1,25 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "main.h"
+
+/*
+ * Binary library snapshot (library.bin) kept next to config.json.
+ *
+ * It mirrors config.json as a string table plus fixed-width track and
+ * playlist records, and remembers the size and mtime of the config.json it
+ * was written alongside.  config_load() maps it instead of parsing JSON as
+ * long as config.json has not changed since.
+ */
+
+#define SNAPSHOT_FILE	"library.bin"
+
+void *snapshot_build(const AppState *state, unsigned long seq, size_t *len);
+void snapshot_stamp(void *image, const struct stat *json_st);
+int snapshot_load(AppState *state, const struct stat *json_st,
+		  unsigned long *seq);
+
+#endif /* SNAPSHOT_H */